@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cassert>
+#include <vector>
+#include <algorithm>
+
+namespace gpc {
+
+    namespace gui {
+
+        namespace gl {
+
+            /** Keeps the most recent samples of a measurement (up to the window size) and
+                computes percentiles over them.
+             */
+            class rolling_percentiles {
+            public:
+
+                explicit rolling_percentiles(size_t window_ = 256) : window{ window_ }
+                {
+                    assert(window > 0);
+                    samples.reserve(window);
+                }
+
+                void add(double sample)
+                {
+                    if (samples.size() < window) samples.push_back(sample);
+                    else samples[next] = sample;
+                    next = (next + 1) % window;
+                }
+
+                auto count() const -> size_t { return samples.size(); }
+
+                /** p is in [0, 1]; returns 0 if there are no samples yet.
+                 */
+                auto percentile(double p) const -> double
+                {
+                    if (samples.empty()) return 0;
+
+                    auto sorted = samples;
+                    auto nth = std::begin(sorted) + static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+                    std::nth_element(std::begin(sorted), nth, std::end(sorted));
+
+                    return *nth;
+                }
+
+                void clear()
+                {
+                    samples.clear();
+                    next = 0;
+                }
+
+            private:
+                size_t window;
+                std::vector<double> samples;
+                size_t next = 0;
+            };
+
+        } // ns gl
+    } // ns gui
+} // ns gpc
@@ -0,0 +1,311 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdexcept>
+#include <algorithm>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <gpc/fonts/rasterized_font.hpp>
+
+namespace gpc {
+
+    namespace gui {
+
+        namespace gl {
+
+            /** "GPU-ready" font file format.
+
+                Holds a rasterized font in exactly the form the renderer uploads it: one pixel blob
+                per variant, plus the glyph and codepoint tables, so that registering such a font
+                involves no per-glyph processing. Quads are derived from the glyph boxes by the
+                vertex shader, so the glyph table doubles as vertex data.
+
+                Layout: header, codepoint table (sorted by codepoint), glyph table (variant-major),
+                variant table, pixel blobs. Every section starts at a multiple of 8 bytes. Values
+                are stored in native byte order.
+             */
+
+            struct gpu_font_header {
+                char            magic[8];           // "GPCGPUFT"
+                std::uint32_t   version;
+                std::uint32_t   variant_count;
+                std::uint32_t   glyph_count;        // per variant
+                std::uint32_t   codepoint_count;
+                std::int32_t    fallback_glyph;     // glyph for codepoints missing from the table, or -1
+                std::uint32_t   reserved;
+                std::uint64_t   codepoints_offset;
+                std::uint64_t   glyphs_offset;
+                std::uint64_t   variants_offset;
+            };
+
+            struct gpu_font_codepoint {
+                std::uint32_t   codepoint;
+                std::int32_t    glyph;
+            };
+
+            struct gpu_font_glyph {
+                std::int32_t    x_min, x_max, y_min, y_max;
+                std::int32_t    adv_x;              // in 1/64 pixels (26.6 fixed point)
+                std::int32_t    pixel_base;         // offset into the pixels of the variant
+            };
+
+            struct gpu_font_variant {
+                std::uint64_t   pixels_offset;
+                std::uint64_t   pixels_size;
+            };
+
+            static const char           gpu_font_magic[8] = { 'G', 'P', 'C', 'G', 'P', 'U', 'F', 'T' };
+            static const std::uint32_t  gpu_font_version = 2;  // 2: advances in 1/64 pixels
+
+            // Conversion from rasterized fonts ---------------------------------
+
+            /** Extracts the glyph records of all variants, variant after variant.
+             */
+            inline auto make_glyph_table(const gpc::fonts::rasterized_font &font) -> std::vector<gpu_font_glyph>
+            {
+                std::vector<gpu_font_glyph> table;
+
+                for (const auto &variant : font.variants) {
+                    for (const auto &glyph : variant.glyphs) {
+                        const auto &bounds = glyph.cbox.bounds;
+                        table.push_back({ bounds.x_min, bounds.x_max, bounds.y_min, bounds.y_max,
+                            static_cast<std::int32_t>(std::lround(glyph.cbox.adv_x * 64.0)), static_cast<std::int32_t>(glyph.pixel_base) });
+                    }
+                }
+
+                return table;
+            }
+
+            /** Builds the codepoint table by querying the font for every Unicode codepoint; meant for
+                offline conversion, and for fonts whose registration is costly anyway (distance fields). Codepoints that map to the same glyph as the noncharacter U+FFFF
+                are considered missing, and that glyph (if any) becomes the fallback glyph.
+             */
+            inline auto make_codepoint_table(const gpc::fonts::rasterized_font &font, std::int32_t &fallback_glyph)
+                -> std::vector<gpu_font_codepoint>
+            {
+                auto glyph_count = font.variants.empty() ? 0LL : static_cast<long long>(font.variants[0].glyphs.size());
+
+                auto lookup = [&](char32_t cp) -> long long {
+                    try {
+                        long long index = font.find_glyph(cp);
+                        return index >= 0 && index < glyph_count ? index : -1;
+                    }
+                    catch(...) { return -1; }
+                };
+
+                fallback_glyph = static_cast<std::int32_t>(lookup(0xFFFF));
+
+                std::vector<gpu_font_codepoint> table;
+                for (char32_t cp = 0; cp < 0x110000; cp++) {
+                    auto index = lookup(cp);
+                    if (index >= 0 && index != fallback_glyph) table.push_back({ cp, static_cast<std::int32_t>(index) });
+                }
+
+                return table;
+            }
+
+            /** Writes a rasterized font in GPU-ready format.
+             */
+            inline void write_gpu_font(std::ostream &os, const gpc::fonts::rasterized_font &font)
+            {
+                auto align = [](std::uint64_t offset) { return (offset + 7) & ~std::uint64_t(7); };
+
+                gpu_font_header header;
+                std::memset(&header, 0, sizeof(header));
+                std::memcpy(header.magic, gpu_font_magic, sizeof(header.magic));
+                header.version = gpu_font_version;
+
+                auto codepoints = make_codepoint_table(font, header.fallback_glyph);
+                auto glyphs = make_glyph_table(font);
+
+                header.variant_count = static_cast<std::uint32_t>(font.variants.size());
+                header.glyph_count = header.variant_count > 0 ? static_cast<std::uint32_t>(font.variants[0].glyphs.size()) : 0;
+                header.codepoint_count = static_cast<std::uint32_t>(codepoints.size());
+                header.codepoints_offset = align(sizeof(header));
+                header.glyphs_offset = align(header.codepoints_offset + codepoints.size() * sizeof(gpu_font_codepoint));
+                header.variants_offset = align(header.glyphs_offset + glyphs.size() * sizeof(gpu_font_glyph));
+
+                std::vector<gpu_font_variant> variants;
+                auto offset = align(header.variants_offset + font.variants.size() * sizeof(gpu_font_variant));
+                for (const auto &variant : font.variants) {
+                    variants.push_back({ offset, variant.pixels.size() });
+                    offset = align(offset + variant.pixels.size());
+                }
+
+                std::uint64_t pos = 0;
+                auto write = [&](std::uint64_t at, const void *data, std::uint64_t size) {
+                    static const char padding[8] = {};
+                    os.write(padding, static_cast<std::streamsize>(at - pos));
+                    os.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+                    pos = at + size;
+                };
+
+                write(0, &header, sizeof(header));
+                write(header.codepoints_offset, codepoints.data(), codepoints.size() * sizeof(gpu_font_codepoint));
+                write(header.glyphs_offset, glyphs.data(), glyphs.size() * sizeof(gpu_font_glyph));
+                write(header.variants_offset, variants.data(), variants.size() * sizeof(gpu_font_variant));
+                for (auto i = 0U; i < variants.size(); i++) {
+                    write(variants[i].pixels_offset, font.variants[i].pixels.data(), variants[i].pixels_size);
+                }
+
+                if (!os) throw std::runtime_error("gpc::gui::gl::write_gpu_font(): write error");
+            }
+
+            // Loading ----------------------------------------------------------
+
+            /** Read-only memory mapping of a GPU-ready font file. The mapping must stay alive until
+                the font has been registered with a renderer.
+             */
+            class mapped_gpu_font {
+            public:
+
+                explicit mapped_gpu_font(const std::string &path);
+
+                ~mapped_gpu_font();
+
+                mapped_gpu_font(const mapped_gpu_font &) = delete;
+                mapped_gpu_font & operator = (const mapped_gpu_font &) = delete;
+
+                auto header() const -> const gpu_font_header & { return *reinterpret_cast<const gpu_font_header*>(data); }
+
+                auto codepoints() const -> const gpu_font_codepoint *
+                {
+                    return reinterpret_cast<const gpu_font_codepoint*>(data + header().codepoints_offset);
+                }
+
+                /** Glyph records of all variants, variant after variant.
+                 */
+                auto glyphs() const -> const gpu_font_glyph *
+                {
+                    return reinterpret_cast<const gpu_font_glyph*>(data + header().glyphs_offset);
+                }
+
+                auto variant(size_t index) const -> const gpu_font_variant &
+                {
+                    return reinterpret_cast<const gpu_font_variant*>(data + header().variants_offset)[index];
+                }
+
+                auto variant_pixels(size_t index) const -> const std::uint8_t * { return data + variant(index).pixels_offset; }
+
+            private:
+
+                void validate() const;
+                void unmap();
+
+                const std::uint8_t *data = nullptr;
+                std::uint64_t size = 0;
+                #ifdef _WIN32
+                HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+                #endif
+            };
+
+            inline mapped_gpu_font::mapped_gpu_font(const std::string &path)
+            {
+                #ifdef _WIN32
+                file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("mapped_gpu_font: cannot open \"" + path + "\"");
+                LARGE_INTEGER file_size;
+                GetFileSizeEx(file, &file_size);
+                size = static_cast<std::uint64_t>(file_size.QuadPart);
+                mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping) data = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                #else
+                auto fd = open(path.c_str(), O_RDONLY);
+                if (fd < 0) throw std::runtime_error("mapped_gpu_font: cannot open \"" + path + "\"");
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                    size = static_cast<std::uint64_t>(st.st_size);
+                    auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (addr != MAP_FAILED) data = static_cast<const std::uint8_t*>(addr);
+                }
+                close(fd);
+                #endif
+
+                try {
+                    if (!data) throw std::runtime_error("mapped_gpu_font: cannot map \"" + path + "\"");
+                    validate();
+                }
+                catch(...) {
+                    unmap();
+                    throw;
+                }
+            }
+
+            inline mapped_gpu_font::~mapped_gpu_font()
+            {
+                unmap();
+            }
+
+            inline void mapped_gpu_font::unmap()
+            {
+                #ifdef _WIN32
+                if (data) UnmapViewOfFile(data);
+                if (mapping) CloseHandle(mapping);
+                if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+                mapping = nullptr, file = INVALID_HANDLE_VALUE;
+                #else
+                if (data) munmap(const_cast<std::uint8_t*>(data), size);
+                #endif
+                data = nullptr;
+            }
+
+            inline void mapped_gpu_font::validate() const
+            {
+                auto fail = [](const char *what) { throw std::runtime_error(std::string("mapped_gpu_font: ") + what); };
+
+                if (size < sizeof(gpu_font_header)) fail("file too small");
+                const auto &hdr = header();
+                if (std::memcmp(hdr.magic, gpu_font_magic, sizeof(hdr.magic)) != 0) fail("not a GPU-ready font file");
+                if (hdr.version != gpu_font_version) fail("unsupported version");
+
+                auto check_section = [&](std::uint64_t offset, std::uint64_t bytes) {
+                    if (offset % 8 != 0 || offset > size || bytes > size - offset) fail("corrupt section table");
+                };
+                check_section(hdr.codepoints_offset, std::uint64_t(hdr.codepoint_count) * sizeof(gpu_font_codepoint));
+                check_section(hdr.glyphs_offset, std::uint64_t(hdr.variant_count) * hdr.glyph_count * sizeof(gpu_font_glyph));
+                check_section(hdr.variants_offset, std::uint64_t(hdr.variant_count) * sizeof(gpu_font_variant));
+                for (auto i = 0U; i < hdr.variant_count; i++) {
+                    check_section(variant(i).pixels_offset, variant(i).pixels_size);
+                    // Pixel blobs become buffer storage, which cannot be empty
+                    if (variant(i).pixels_size == 0) fail("empty pixel section");
+                }
+
+                // Everything the renderer indexes with must stay within its table
+                if (hdr.variant_count == 0) fail("no variants");
+                if (hdr.glyph_count == 0) fail("no glyphs");
+                if (hdr.fallback_glyph < -1 || hdr.fallback_glyph >= static_cast<std::int64_t>(hdr.glyph_count)) fail("fallback glyph out of range");
+                for (auto i = 0U; i < hdr.codepoint_count; i++) {
+                    auto glyph = codepoints()[i].glyph;
+                    if (glyph < 0 || static_cast<std::uint32_t>(glyph) >= hdr.glyph_count) fail("codepoint glyph out of range");
+                }
+                for (auto i = 0U; i < hdr.variant_count; i++) {
+                    for (auto j = 0U; j < hdr.glyph_count; j++) {
+                        const auto &glyph = glyphs()[std::uint64_t(i) * hdr.glyph_count + j];
+                        std::int64_t w = std::int64_t(glyph.x_max) - glyph.x_min, h = std::int64_t(glyph.y_max) - glyph.y_min;
+                        if (w <= 0 || h <= 0) continue;
+                        if (glyph.pixel_base < 0 || static_cast<std::uint64_t>(glyph.pixel_base + w * h) > variant(i).pixels_size) fail("glyph pixels out of range");
+                    }
+                }
+            }
+
+        } // ns gl
+    } // ns gui
+} // ns gpc
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+namespace gpc {
+
+    namespace gui {
+
+        namespace gl {
+
+            enum class memory_category { images = 0, fonts, streaming, layers };
+
+            static const size_t memory_category_count = 4;
+
+            inline auto memory_category_name(memory_category category) -> const char *
+            {
+                static const char *names[memory_category_count] = { "images", "fonts", "streaming", "layers" };
+                return names[static_cast<size_t>(category)];
+            }
+
+            struct memory_allocation {
+                memory_category category;
+                size_t          bytes;
+                std::string     label;
+            };
+
+            /** Keeps track of the GPU memory owned by a renderer, per allocation and per category.
+                Allocations are identified by a key chosen by the owner (e.g. derived from the GL object
+                name); allocating under an existing key replaces that allocation.
+             */
+            class memory_ledger {
+            public:
+
+                using key = std::uint64_t;
+
+                void allocate(key id, memory_category category, size_t bytes, std::string label)
+                {
+                    release(id);
+                    totals[static_cast<size_t>(category)] += bytes;
+                    grand_total += bytes;
+                    peak_total = std::max(peak_total, grand_total);
+                    allocations[id] = { category, bytes, std::move(label) };
+                }
+
+                void release(key id)
+                {
+                    auto it = allocations.find(id);
+                    if (it == std::end(allocations)) return;
+                    totals[static_cast<size_t>(it->second.category)] -= it->second.bytes;
+                    grand_total -= it->second.bytes;
+                    allocations.erase(it);
+                }
+
+                auto total(memory_category category) const -> size_t { return totals[static_cast<size_t>(category)]; }
+
+                auto total() const -> size_t { return grand_total; }
+
+                // Highest total reached so far
+                auto peak() const -> size_t { return peak_total; }
+
+                auto count() const -> size_t { return allocations.size(); }
+
+                /** Returns the specified number of allocations, largest first.
+                 */
+                auto largest(size_t count) const -> std::vector<memory_allocation>
+                {
+                    std::vector<memory_allocation> result;
+                    result.reserve(allocations.size());
+                    for (const auto &entry : allocations) result.push_back(entry.second);
+
+                    count = std::min(count, result.size());
+                    std::partial_sort(std::begin(result), std::begin(result) + count, std::end(result),
+                        [](const memory_allocation &a, const memory_allocation &b) { return a.bytes > b.bytes; });
+                    result.resize(count);
+
+                    return result;
+                }
+
+                /** Writes the totals and the largest allocations in human-readable form.
+                 */
+                void dump(std::ostream &os, size_t count = 10) const
+                {
+                    os << "GPU memory: " << grand_total << " bytes in " << allocations.size() << " allocations"
+                        << " (peak " << peak_total << ")" << std::endl;
+                    for (auto i = 0U; i < memory_category_count; i++) {
+                        os << "  " << std::left << std::setw(10) << memory_category_name(static_cast<memory_category>(i))
+                            << std::right << std::setw(12) << totals[i] << std::endl;
+                    }
+                    for (const auto &alloc : largest(count)) {
+                        os << "  " << std::setw(12) << alloc.bytes << "  " << std::left << std::setw(10)
+                            << memory_category_name(alloc.category) << std::right << alloc.label << std::endl;
+                    }
+                }
+
+            private:
+                std::unordered_map<key, memory_allocation> allocations;
+                std::array<size_t, memory_category_count> totals = {{ 0, 0, 0, 0 }};
+                size_t grand_total = 0, peak_total = 0;
+            };
+
+        } // ns gl
+    } // ns gui
+} // ns gpc
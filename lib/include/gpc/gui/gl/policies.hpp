@@ -0,0 +1,135 @@
+#pragma once
+
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <utility>
+
+#include <gpc/gl/wrappers.hpp>
+
+namespace gpc {
+
+    namespace gui {
+
+        namespace gl {
+
+            using namespace ::gl;
+
+            // GL call policies -----------------------------------------------
+
+            /** Calls the OpenGL function, then queries glGetError() and reports any error
+                together with the name of the offending function.
+             */
+            struct checked_gl_calls {
+
+                template <typename F, typename... Args>
+                static auto call(const char *name, F fn, Args&&... args) -> decltype(fn(std::forward<Args>(args)...))
+                {
+                    error_check check{ name };
+                    return fn(std::forward<Args>(args)...);
+                }
+
+            private:
+
+                struct error_check {
+                    const char *name;
+                    ~error_check()
+                    {
+                        auto err = glGetError();
+                        if (err != GL_NO_ERROR) {
+                            std::cerr << "OpenGL error 0x" << std::hex << static_cast<unsigned>(err) << std::dec
+                                << " in gl" << name << std::endl;
+                            assert(false);
+                        }
+                    }
+                };
+            };
+
+            /** Calls the OpenGL function directly; the call compiles down to nothing more
+                than the function call itself.
+             */
+            struct unchecked_gl_calls {
+
+                template <typename F, typename... Args>
+                static auto call(const char * /*name*/, F fn, Args&&... args) -> decltype(fn(std::forward<Args>(args)...))
+                {
+                    return fn(std::forward<Args>(args)...);
+                }
+            };
+
+            // Instrumentation policies ---------------------------------------
+
+            /** Retrieves and logs shader info logs, validates usage (e.g. clipping nesting)
+                and counts draw calls and state changes.
+             */
+            struct full_instrumentation {
+
+                static constexpr bool enabled = true;
+
+                struct counters {
+                    unsigned draw_calls = 0;
+                    unsigned state_changes = 0;
+
+                    void count_draw_call() { draw_calls++; }
+                    void count_state_change() { state_changes++; }
+                    void reset() { draw_calls = 0, state_changes = 0; }
+                };
+
+                static void shader_log(const char *what, const std::string &log)
+                {
+                    if (!log.empty()) std::cerr << what << " log:" << std::endl << log << std::endl;
+                }
+            };
+
+            /** No logging, no validation, no counting.
+             */
+            struct no_instrumentation {
+
+                static constexpr bool enabled = false;
+
+                struct counters {
+                    static constexpr unsigned draw_calls = 0;
+                    static constexpr unsigned state_changes = 0;
+
+                    void count_draw_call() {}
+                    void count_state_change() {}
+                    void reset() {}
+                };
+
+                static void shader_log(const char * /*what*/, const std::string & /*log*/) {}
+            };
+
+            // Configurations -------------------------------------------------
+
+            /** Bundles the compile-time policies of a renderer. Further policies (batching
+                strategy, text pipeline) are meant to be added here as alternatives become
+                available.
+             */
+            template <
+                typename GLCalls,
+                typename Instrumentation
+            >
+            struct renderer_config {
+                using gl_calls          = GLCalls;
+                using instrumentation   = Instrumentation;
+            };
+
+            using checked_config    = renderer_config<checked_gl_calls, full_instrumentation>;
+            using production_config = renderer_config<unchecked_gl_calls, no_instrumentation>;
+
+            // GPCGUIGL_CHECKED can be set by the build system to override the choice based on NDEBUG
+            #if defined(GPCGUIGL_CHECKED)
+            #if GPCGUIGL_CHECKED
+            using default_config = checked_config;
+            #else
+            using default_config = production_config;
+            #endif
+            #elif defined(NDEBUG)
+            using default_config = production_config;
+            #else
+            using default_config = checked_config;
+            #endif
+
+        } // ns gl
+    } // ns gui
+} // ns gpc
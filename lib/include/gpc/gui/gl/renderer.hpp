@@ -3,9 +3,25 @@
 #include <iostream>
 #include <cassert>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <ostream>
+#include <initializer_list>
+#include <utility>
 #include <mutex>
 #include <string>
 #include <array>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <numeric>
 #ifdef FORCE_GLEW
 #ifdef _WIN32
 #include <Windows.h>
@@ -19,6 +35,14 @@
 #include <gpc/fonts/rasterized_font.hpp>
 #include <gpc/gui/renderer.hpp>
 
+#include "policies.hpp"
+#include "gpu_font.hpp"
+#include "frame_statistics.hpp"
+#include "gpu_memory.hpp"
+
+// Calls an OpenGL function through the GL call policy of the renderer configuration
+#define GLCALL(name, ...) config::gl_calls::call(#name, gl##name, ##__VA_ARGS__)
+
 namespace gpc {
 
     namespace gui {
@@ -38,13 +62,22 @@ namespace gpc {
                 TODO: inherit from base Renderer that defines default metadata (see below)
                 TODO: provide a concept checker ?
                 TODO: change "rectangle" interfaces to use vertices only instead of vertices + extents ?
+
+                The Config parameter selects compile-time policies (see policies.hpp): whether
+                GL calls are error-checked, and whether shader logs, usage validation and
+                statistics are compiled in.
              */
             template <
-                bool YAxisDown
+                bool YAxisDown,
+                typename Config = default_config
             >
             class renderer {
             public:
 
+                using config = Config;
+                using instrumentation = typename Config::instrumentation;
+                using counters = typename instrumentation::counters;
+
                 // Metadata
 
                 static const bool font_mapping_is_expensive = true;
@@ -79,14 +112,80 @@ namespace gpc {
                     return color;
                 }
 
+                /** Renderers whose GL contexts belong to the same share group can share their shader
+                    program, images and fonts (and memory budget): construct the second and further ones
+                    with the resource_context() of the first. Viewport, streaming buffers, frame pacing
+                    and sorted submission stay per renderer.
+
+                    Call enter_context() whenever the context of a renderer has been made current; it
+                    re-applies per-renderer state to the shared program. As usual with shared contexts, 
+                    resources registered in one context must be synchronized (e.g. by a fence or a 
+                    glFinish()) before another context can rely on them.
+                 */
+
+                class shared_resources;
+
                 // Lifecycle
 
                 renderer();
 
+                explicit renderer(std::shared_ptr<shared_resources> resources);
+
+                auto resource_context() const -> std::shared_ptr<shared_resources> { return resources; }
+
+                // Retained mode (see below)
+                class retained_scene;
+
                 void enter_context();
 
                 void leave_context();
 
+                /** Frame pacing. Calls to begin_frame() and end_frame() bracket the rendering of a frame
+                    (end_frame() should come before the buffer swap). end_frame() inserts a fence, and
+                    begin_frame() blocks until no more than the allowed number of frames are still
+                    being processed by the GPU. Timer queries measure each frame on the GPU side.
+                 */
+
+                void begin_frame();
+
+                void end_frame();
+
+                void set_max_frames_in_flight(unsigned count);
+
+                struct frame_timing {
+                    size_t      frames_measured;        // size of the rolling window so far
+                    size_t      frames_in_flight;
+                    double      cpu_submit_ms_p50, cpu_submit_ms_p99;   // begin_frame() to end_frame()
+                    double      gpu_ms_p50, gpu_ms_p99;                 // GPU execution of the frame's commands
+                    double      latency_ms_p50, latency_ms_p99;         // begin_frame() to GPU completion
+                };
+
+                auto frame_timing_statistics() const -> frame_timing;
+
+                /** Sorted submission. Between begin_sorted() and end_sorted(), drawing calls are recorded
+                    instead of executed. On submission, commands are ordered by layer, and commands that
+                    do not overlap earlier ones are moved forward to join commands using the same render
+                    mode and texture. Clipping and clearing submit what has been recorded so far.
+                    Bulk calls are recorded as a single command covering all of their primitives 
+                    (draw_images(): one per run of the same image).
+                 */
+
+                void begin_sorted();
+
+                void end_sorted();
+
+                // Layer for subsequently recorded commands; higher layers are drawn on top (default: 0)
+                void set_layer(int layer);
+
+                struct sort_statistics {
+                    size_t      commands;
+                    size_t      state_changes_before;   // render mode / texture switches in call order
+                    size_t      state_changes_after;    // same, after reordering
+                };
+
+                // Statistics of the most recent begin_sorted() / end_sorted() sequence
+                auto last_sort_statistics() const -> const sort_statistics & { return sort_stats; }
+
                 void define_viewport(int x, int y, int width, int height);
 
                 void clear(const rgba_norm &color);
@@ -127,29 +226,192 @@ namespace gpc {
                 void draw_greyscale_image_up_righthand(int x, int y, int length, int width, 
                     image_handle, const rgba_norm &color,  int offset_x = 0, int offset_y = 0);
 
+                /** Shape primitives, each evaluated analytically by the fragment shader in a single draw.
+                    Coordinates are in pixels; radius is the corner radius (0 = square corners).
+                 */
+
+                void fill_rounded_rect(int x, int y, int w, int h, int radius, const rgba_norm &color);
+
+                // The border is drawn inside the rectangle
+                void stroke_rounded_rect(int x, int y, int w, int h, int radius, int border_width, const rgba_norm &color);
+
+                // Gradient from color0 at (x0, y0) to color1 at (x1, y1); identical points fill with color0
+                void fill_linear_gradient(int x, int y, int w, int h, int radius, 
+                    int x0, int y0, const rgba_norm &color0, int x1, int y1, const rgba_norm &color1);
+
+                // Gradient from inner at (cx, cy) to outer at distance r and beyond; r = 0 fills with outer
+                void fill_radial_gradient(int x, int y, int w, int h, int radius,
+                    int cx, int cy, int r, const rgba_norm &inner, const rgba_norm &outer);
+
+                // Shadow of the specified rectangle, spreading blur pixels beyond it
+                void draw_drop_shadow(int x, int y, int w, int h, int radius, int blur, const rgba_norm &color);
+
+                /** Bulk submission: each of these draws an array of primitives as instances of a single
+                    quad. The array is copied into a streaming buffer in one piece, without per-element
+                    processing, so the structures mirror the vertex attribute layout of the shaders.
+                    The overloads taking separate arrays (structure of arrays) upload each of them as
+                    a section of the same buffer.
+                 */
+
+                struct rect_color {
+                    GLint       x, y, w, h;
+                    rgba_norm   color;
+                };
+
+                void fill_rects(const rect_color *rects, size_t count);
+
+                // rects holds x, y, w, h of each rectangle
+                void fill_rects(const GLint *rects, const rgba_norm *colors, size_t count);
+
+                struct image_instance {
+                    GLint       x, y, w, h;
+                    image_handle image;
+                    GLint       offset_x, offset_y;
+                };
+
+                // Consecutive instances of the same image are drawn with a single draw call
+                void draw_images(const image_instance *images, size_t count);
+
+                // rects holds x, y, w, h and offsets (which may be null) offset_x, offset_y of each instance
+                void draw_images(const GLint *rects, const image_handle *images, const GLint *offsets, size_t count);
+
                 void set_clipping_rect(int x, int y, int w, int h);
 
                 void cancel_clipping();
 
-                auto register_font(const rasterized_font &font) -> font_handle;
+                /** Registers a font for use with render_text(). If subpixel_steps is greater than 1,
+                    each glyph can be positioned at that many horizontal subpixel offsets; the shifted
+                    glyph bitmaps are generated on first use and kept in a per-font glyph cache.
+                 */
+                auto register_font(const rasterized_font &font, int subpixel_steps = 1) -> font_handle;
+
+                /** Registers a font as a signed distance field, generated on the CPU (in parallel) from
+                    the rasterized glyphs. Such a font can be rendered at any scale via render_text_scaled();
+                    spread is the distance range, in pixels of the rasterized font, that the field covers
+                    on each side of the glyph outlines, and limits how far the font can be magnified.
+                    The edges are located from the antialiased coverage, to a fraction of a pixel; still,
+                    the field cannot hold more detail than the rasterization, so register a font rasterized 
+                    at (at least) the largest size it will be displayed at divided by 4, and a spread of 
+                    at least 4 (magnification up to about 2 x spread). A font rasterized at 32 pixels with a 
+                    spread of 4 to 8 suits typical UI sizes.
+                 */
+                auto register_sdf_font(const rasterized_font &font, int spread = 4) -> font_handle;
+
+                /** Registers a font from a GPU-ready font file (see gpu_font.hpp): the pixels are uploaded
+                    straight from the mapping, and only the (small) glyph and codepoint tables are copied.
+                    The mapping can be released as soon as this returns.
+                 */
+                auto register_font(const mapped_gpu_font &file) -> font_handle;
 
                 void release_font(font_handle reg_font);
                 //void release_font(const rasterized_font &);
 
                 void set_text_color(const rgba_norm &color);
 
+                // Selects the font variant used by all text rendering methods (default: 0)
+                void set_text_variant(int variant);
+
                 // auto get_text_extents(reg_font_t font, const char32_t *text, size_t count) -> text_bbox_t;
 
                 void render_text(font_handle font, int x, int y, const char32_t *text, size_t count, int w_max = 0);
 
+                /** Same as render_text(), but starting at a fractional horizontal position. The pen
+                    position is tracked with subpixel precision throughout the run, and each glyph
+                    is drawn from the cached variant closest to its fractional position.
+                 */
+                void render_text_subpixel(font_handle font, float x, int y, const char32_t *text, size_t count, int w_max = 0);
+
+                /** Renders text with a font registered via register_sdf_font(), magnified or reduced by
+                    the specified factor. w_max is in (scaled) pixels.
+                 */
+                void render_text_scaled(font_handle font, int x, int y, float scale, const char32_t *text, size_t count, int w_max = 0);
+
+                struct text_item {
+                    font_handle     font;
+                    int             x, y;
+                    const char32_t *text;
+                    size_t          count;
+                    rgba_norm       color;
+                    int             w_max;
+                };
+
+                /** Renders a number of texts; consecutive items using the same font and color are drawn
+                    as a single glyph run. The text color set via set_text_color() is not affected.
+                 */
+                void render_texts(const text_item *items, size_t count);
+
+                struct font_memory_usage {
+                    size_t glyph_pixels;        // GPU bytes holding the glyph pixels as registered
+                    size_t distance_field;      // GPU bytes holding the distance field (SDF fonts only)
+                    size_t subpixel_cache;      // GPU bytes allocated for the subpixel glyph cache
+                    size_t subpixel_cache_used; // part of the above that is actually filled
+                };
+
+                auto font_memory(font_handle font) const -> font_memory_usage;
+
+                /** GPU memory accounting. Every texture and buffer the renderer allocates is recorded
+                    in one of the categories images, fonts, streaming (per-draw vertex data) and layers.
+                 */
+
+                struct gpu_memory_usage {
+                    size_t images, fonts, streaming, layers;
+                    size_t total, peak;         // in bytes
+                    size_t budget;              // 0 = none
+                };
+
+                auto gpu_memory() const -> gpu_memory_usage;
+
+                // Writes the per-category totals and the count largest allocations
+                void dump_gpu_memory(std::ostream &os, size_t count = 10) const;
+
+                /** Memory budget. When the total exceeds it, the renderer first discards subpixel glyph
+                    caches (they are regenerated on demand), then evicts images declared evictable, least
+                    recently drawn first; images used by a retained scene are never evicted. If that is not
+                    enough, the budget_exceeded callback is called with the remaining excess. The budget is
+                    enforced when resources are registered and at begin_frame(), never while any renderer
+                    sharing the resources is recording sorted submission.
+                 */
+
+                using eviction_callback = std::function<void(image_handle)>;
+                using budget_callback = std::function<void(size_t excess)>;
+
+                void set_memory_budget(size_t bytes, budget_callback budget_exceeded = budget_callback());
+
+                /** Allows the renderer to release the image to stay within the memory budget; on_evicted
+                    is called after the image has been released, so the owner can re-register it when
+                    it is next needed.
+                 */
+                void make_image_evictable(image_handle image, eviction_callback on_evicted);
+
+                void enforce_memory_budget();
+
                 void init();
 
                 void cleanup();
 
                 void draw_rect(int x, int y, int width, int height);
 
+                // Statistics (always zero unless instrumentation is enabled)
+
+                auto statistics() const -> const counters & { return stats; }
+
+                void reset_statistics() { stats.reset(); }
+
             private:
 
+                enum paint_mode { solid_paint = 0, linear_gradient_paint = 1, radial_gradient_paint = 2 };
+
+                // Compilation errors surface when linking; the info log is only retrieved when instrumented
+                static void compile_shader(GLuint shader, const std::string &code, const char *what);
+
+                // Redundant state changes are skipped; enter_context() resets what is known about the GL state
+                void use_render_mode(int mode);
+                void bind_image_texture(GLuint texture); // texture unit 0
+                void bind_font_texture(GLuint texture);  // texture unit 1
+
+                void _draw_shape(int x, int y, int w, int h, int radius, int border_width, int blur,
+                    const rgba_norm &color, paint_mode paint = solid_paint, const GLfloat *gradient = nullptr, const rgba_norm *color2 = nullptr);
+
                 void _draw_greyscale_image(int x, int y, int w, int h, image_handle, const rgba_norm &color,
                     int origin_x, int origin_y, float texrot_sin, float texrot_cos, int offset_x = 0, int offset_y = 0);
 
@@ -169,45 +431,421 @@ namespace gpc {
                     };
                 }
 
-                struct managed_font: gpc::fonts::rasterized_font {
-                    
-                    managed_font(const rasterized_font &font_) : gpc::fonts::rasterized_font{ font_ } {}
+                // Per-instance attributes of a glyph in a text run (see vertex.glsl)
+                struct glyph_instance {
+                    GLint x, y;                         // pen position
+                    GLint pixel_base;                   // offset of the glyph's pixels in the font texture
+                    GLint x_min, x_max, y_min, y_max;   // glyph bounding box
+                };
+
+                struct managed_font {
                     
-                    void store_pixels();
-                    void create_quads();
+                    // Without the codepoint table, a copy of the font (minus its pixels, unless subpixel
+                    // steps need them) serves as the glyph lookup
+                    managed_font(const rasterized_font &font_, int subpixel_steps_, bool codepoint_table = false);
+                    managed_font(const mapped_gpu_font &file);
+
+                    auto find_glyph(char32_t codepoint) const -> int;
+
+                    auto glyph(int var_index, int glyph_index) const -> const gpu_font_glyph &
+                    {
+                        return glyphs[var_index * glyph_count + glyph_index];
+                    }
+
+                    void store_pixels(const std::uint8_t *pixels, size_t size); // call once per variant
+
+                    void account_memory(memory_ledger &memory, font_handle handle) const;
+
+                    // Signed distance field
+
+                    void generate_distance_field(const rasterized_font &font, int spread);
+                    void store_distance_field();
+
+                    // Subpixel glyph cache
+
+                    struct cached_glyph {
+                        GLint pixel_base;
+                        GLint x_min, x_max, y_min, y_max;
+                    };
+
+                    auto variant_offset(int var_index) const -> size_t; // of the variant's pixels in the cache
+                    auto subpixel_glyph(int var_index, int glyph_index, int step) -> cached_glyph;
+                    void flush_subpixel_cache();
+                    auto discard_subpixel_cache() -> size_t; // returns the number of bytes freed
+
+                    // Glyph lookup; keeps the rasterized pixels only when the subpixel cache needs them.
+                    // Null for fonts looked up via the codepoint table.
+                    std::shared_ptr<const rasterized_font> source;
+                    std::vector<gpu_font_codepoint> codepoints;     // only used when source is null
+                    std::int32_t fallback_glyph = -1;
+                    size_t variant_count, glyph_count;
+                    std::vector<gpu_font_glyph> glyphs;             // (variant * glyph count + glyph)
+                    size_t pixel_bytes = 0;
 
                     std::vector<GLuint> buffer_textures;
+                    std::vector<size_t> buffer_sizes;   // in bytes, per buffer texture
                     std::vector<GLuint> textures; // one 1D texture per variant
-                    GLuint vertex_buffer;
+
+                    int subpixel_steps;
+                    std::vector<GLint> cache_slots;         // (glyph * (steps - 1) + step - 1) -> index into cached_glyphs, or -1
+                    std::vector<cached_glyph> cached_glyphs;
+                    std::vector<std::uint8_t> pending_pixels; // generated but not yet uploaded
+                    // The cache starts with a copy of all variants' pixels, so that a single buffer texture 
+                    // serves shifted and unshifted glyphs alike; cache_size includes that copy even while 
+                    // the buffer does not exist
+                    size_t cache_size = 0, cache_capacity = 0;  // in bytes (= texels)
+                    GLuint cache_buffer = 0, cache_texture = 0;
+
+                    int sdf_spread = 0;                     // 0 = bitmap font
+                    std::vector<cached_glyph> sdf_glyphs;   // (variant * glyph count + glyph) -> padded glyph
+                    std::vector<std::uint8_t> sdf_pixels;   // only kept until uploaded
+                    size_t sdf_size = 0;
+                    GLuint sdf_buffer = 0, sdf_texture = 0;
                 };
 
+                void _render_sdf_text(managed_font &mfont, float x, int y, float scale, const char32_t *text, size_t count, int w_max);
+
+                // Glyph run assembly (appending to glyph_run) and drawing, shared by the text rendering methods
+                void _append_bitmap_glyphs(managed_font &mfont, float x, int y, const char32_t *text, size_t count, int w_max);
+                void _append_sdf_glyphs(managed_font &mfont, float x, int y, float scale, const char32_t *text, size_t count, int w_max);
+                void _draw_bitmap_glyphs(font_handle handle, managed_font &mfont);
+
+                // Binds the unit quad as attribute 0 and the specified instance data as GL_ARRAY_BUFFER;
+                // with null data, the buffer is only allocated, to be filled by upload_instance_section()
+                void upload_instances(const void *data, size_t size);
+                void upload_instance_section(size_t byte_offset, const void *data, size_t size);
+                void _fill_rect_instances(size_t count);
+                template <typename ImageAt> void _draw_image_instances(size_t count, ImageAt image_at);
+
+                void draw_glyph_run(GLuint font_texture, int render_mode = 3, float scale = 1);
+
                 //static const std::string vertex_code, fragment_code;
 
                 GLuint vertex_buffer, index_buffer;
-                GLuint vertex_shader, fragment_shader;
-                GLuint program;
-                std::vector<GLuint> image_textures;
-                std::vector<managed_font> managed_fonts;
+                GLuint quad_corner_buffer, glyph_instance_buffer;
+                GLuint bulk_instance_buffer;
+                std::vector<glyph_instance> glyph_run;
+                std::shared_ptr<shared_resources> resources;
+                unsigned seen_modifications = 0;        // see shared_resources::modifications
                 GLint vp_width, vp_height;
                 rgba_norm text_color;
+                int text_variant = 0;
+                counters stats;
 
-                #ifdef DEBUG
-                bool dbg_clipping_active = false;
-                #endif
+                bool dbg_clipping_active = false; // only used when instrumentation is enabled
+
+                // Frame pacing
+
+                struct frame_record {
+                    GLsync      fence;
+                    GLuint      queries[2];     // GPU timestamps at start and end of frame
+                    std::chrono::steady_clock::time_point cpu_begin;
+                    double      cpu_submit_ms;
+                };
+
+                void retire_frames(bool wait_for_oldest);
+
+                // Reading GL_TIMESTAMP synchronously is a round trip to the GPU, so the offset between
+                // the GPU and CPU clocks is only sampled every so many frames (to follow any drift)
+                static constexpr unsigned clock_sync_interval = 1000;
+                unsigned frames_since_clock_sync = clock_sync_interval;
+                GLint64 gpu_clock_offset = 0;   // GPU time minus steady_clock time, in nanoseconds
+
+                unsigned max_frames_in_flight = 2;
+                bool in_frame = false;
+                frame_record current_frame;
+                std::deque<frame_record> frames_in_flight;
+                std::vector<GLuint> free_queries;
+                rolling_percentiles cpu_submit_times, gpu_times, frame_latencies;
+
+                // State tracking
+
+                static constexpr GLuint unknown_state = std::numeric_limits<GLuint>::max();
+
+                int current_render_mode = -1;
+                GLuint bound_image_texture = unknown_state, bound_font_texture = unknown_state;
+
+                // Sorted submission
+
+                // What a recorded command draws; its parameters are kept in the arena of that kind
+                enum recorded_kind { recorded_rects, recorded_images, recorded_greyscale, recorded_shape, recorded_glyphs };
+
+                struct recorded_command {
+                    int layer;
+                    int x, y, w, h;             // bounding rectangle
+                    int render_mode;
+                    GLuint texture;
+                    recorded_kind kind;
+                    size_t first, count;        // range in the arena of the kind
+                };
+
+                struct recorded_greyscale_image {
+                    int x, y, w, h;
+                    image_handle img;
+                    rgba_norm color;
+                    int origin_x, origin_y;
+                    float texrot_sin, texrot_cos;
+                    int offset_x, offset_y;
+                };
+
+                struct recorded_shape_params {
+                    int x, y, w, h, radius, border_width, blur;
+                    rgba_norm color, color2;
+                    paint_mode paint;
+                    GLfloat gradient[4];
+                };
+
+                struct recorded_glyph_run {
+                    size_t first, count;        // range in recorded_glyph_instances
+                    rgba_norm color;
+                    float scale;
+                };
+
+                void record_command(int x, int y, int w, int h, int render_mode, GLuint texture, recorded_kind kind, size_t first, size_t count = 1);
+                void execute_recorded(const recorded_command &command);
+                void submit_recorded();
+                auto glyph_run_bounds(int render_mode, float scale) const -> std::array<int, 4>;
+                template <typename Instance> static auto union_bounds(const Instance *instances, size_t count) -> std::array<int, 4>;
+
+                bool recording = false;
+                int current_layer = 0;
+                std::vector<recorded_command> recorded_commands;
+                std::vector<rect_color> recorded_rect_params;
+                std::vector<image_instance> recorded_image_params;
+                std::vector<recorded_greyscale_image> recorded_greyscale_params;
+                std::vector<recorded_shape_params> recorded_shapes;
+                std::vector<recorded_glyph_run> recorded_glyph_runs;
+                std::vector<glyph_instance> recorded_glyph_instances;
+                std::vector<size_t> recorded_order;                         // command indices, batch after batch
+                std::vector<int> placement_grid;                            // latest batch touching each cell, or -1
+                std::unordered_map<std::uint64_t, std::vector<size_t>> batches_by_state;
+                sort_statistics sort_stats = { 0, 0, 0 };
+
+                // Memory accounting
+
+                static auto texture_memory(GLuint texture) -> memory_ledger::key { return texture; }
+                static auto buffer_memory(GLuint buffer) -> memory_ledger::key { return (memory_ledger::key(1) << 32) | buffer; }
+
+                struct evictable_image {
+                    eviction_callback   on_evicted;
+                    std::uint64_t       last_use;
+                };
+
+                void account_image(image_handle image, size_t width, size_t height, size_t bytes_per_pixel, const char *format);
+
+                size_t glyph_instance_bytes = 0, bulk_instance_bytes = 0;
+            };
+
+            /** The resources shared between renderers: shader program, images and fonts, plus the memory
+                accounting covering all of them (including the streaming buffers of each renderer).
+             */
+            template <bool YAxisDown, typename Config>
+            class renderer<YAxisDown, Config>::shared_resources {
+            public:
+
+                shared_resources() = default;
+
+                shared_resources(const shared_resources &) = delete;
+                shared_resources & operator = (const shared_resources &) = delete;
+
+            private:
+                friend class renderer;
+
+                GLuint vertex_shader = 0, fragment_shader = 0;
+                GLuint program = 0;
+                std::vector<GLuint> image_textures;
+                std::vector<managed_font> managed_fonts;
+
+                // Incremented whenever a shared texture is deleted or changes its contents or storage, 
+                // so that renderers can tell when their cached texture bindings may be stale
+                unsigned modifications = 0;
+
+                memory_ledger memory;
+                size_t memory_budget = 0;
+                bool enforcing_budget = false;
+                unsigned recording_renderers = 0;       // in sorted submission; their commands pin everything
+                std::unordered_map<image_handle, unsigned> scene_image_refs; // images used by retained scenes
+                budget_callback budget_exceeded;
+                std::unordered_map<image_handle, evictable_image> evictable_images;
+                std::uint64_t image_use_clock = 0;
+            };
+
+            /** Retained mode: a scene of rectangles, images, text runs and clip groups that is kept in
+                GPU buffers between frames. Each node is stored as one instance record (one per glyph for
+                text runs); changing a node rewrites only its records, which are uploaded with sub-buffer
+                writes on the next draw(). The scene is drawn with one glMultiDrawElementsIndirect() per
+                batch of nodes sharing render mode and texture, the batches being formed, as in sorted 
+                submission, without changing the outcome of overlapping nodes.
+
+                Nodes are drawn in the order they were added. All coordinates are absolute; a clip group
+                clips the nodes added to it (and to its child groups) to its rectangle. Node IDs stay
+                valid until the node is removed, and are not reused. Text nodes require bitmap fonts and
+                are placed at whole pixels. When a node moves, changes size or image, or is shown again,
+                it keeps its batch if that still respects its overlaps with other nodes (found via a
+                coarse grid); otherwise it is moved to a batch that does, and only the draw commands of
+                the batches concerned are rewritten. The batches are re-formed from scratch only when no
+                such batch exists.
+
+                A scene belongs to the renderer it was created with, whose context must be current.
+             */
+            template <bool YAxisDown, typename Config>
+            class renderer<YAxisDown, Config>::retained_scene {
+            public:
+
+                using node_id = std::uint32_t; // 0 = none / top level
+
+                explicit retained_scene(renderer &rend);
+
+                ~retained_scene();
+
+                retained_scene(const retained_scene &) = delete;
+                retained_scene & operator = (const retained_scene &) = delete;
+
+                auto add_rect(int x, int y, int w, int h, const rgba_norm &color, node_id parent = 0) -> node_id;
+
+                auto add_image(int x, int y, int w, int h, image_handle image, int offset_x = 0, int offset_y = 0, 
+                    node_id parent = 0) -> node_id;
+
+                // (x, y) is the origin of the text, as with render_text(); uses the current text variant
+                auto add_text(font_handle font, int x, int y, const char32_t *text, size_t count, const rgba_norm &color,
+                    node_id parent = 0) -> node_id;
+
+                auto add_clip_group(int x, int y, int w, int h, node_id parent = 0) -> node_id;
+
+                void set_position(node_id node, int x, int y);
+
+                void set_size(node_id node, int w, int h); // not applicable to text nodes
+
+                void set_color(node_id node, const rgba_norm &color); // rectangle and text nodes
+
+                void set_image(node_id node, image_handle image, int offset_x = 0, int offset_y = 0);
+
+                void set_text(node_id node, const char32_t *text, size_t count);
+
+                // Hiding a clip group hides its contents
+                void set_visible(node_id node, bool visible);
+
+                // Removing a clip group removes its contents
+                void remove(node_id node);
+
+                /** Uploads the changed instance records and updates the batches and their draw commands;
+                    draw() starts with this. Can be called ahead of drawing, e.g. to read statistics().
+                 */
+                void update();
+
+                void draw();
+
+                struct scene_statistics {
+                    size_t      nodes;
+                    size_t      instances;          // instance records in use
+                    size_t      batches;            // = glMultiDrawElementsIndirect() calls per draw()
+                    size_t      draw_commands;
+                    size_t      bytes_uploaded;     // by the most recent draw()
+                };
+
+                auto statistics() const -> const scene_statistics & { return stats; }
+
+            private:
+
+                // Mirrors vertex attributes 4 - 7 (see vertex.glsl)
+                struct instance_record {
+                    GLint       x, y, w, h;
+                    GLfloat     color[4];
+                    GLint       offset_x, offset_y;     // images: top-left corner inside image; glyphs: pixel base
+                    GLint       clip_x, clip_y, clip_w, clip_h; // clip_w = 0: no clipping
+                };
+
+                // As defined for glMultiDrawElementsIndirect()
+                struct draw_command {
+                    GLuint      count, instance_count, first_index;
+                    GLint       base_vertex;
+                    GLuint      base_instance;
+                };
+
+                enum class node_kind { removed, rect, image, text, clip_group };
+
+                struct node {
+                    node_kind   kind;
+                    node_id     parent;
+                    std::vector<node_id> children;
+                    bool        visible;
+                    int         x, y, w, h;             // text: origin only
+                    rgba_norm   color;
+                    image_handle image;
+                    int         offset_x, offset_y;
+                    font_handle font;
+                    int         variant;                // text: font variant
+                    std::u32string text;
+                    size_t      first, count;           // instance records
+                    int         batch;                  // -1 = none
+                    std::array<int, 4> placed;          // bounds as entered into the placement grid
+                };
+
+                struct batch {
+                    int         render_mode;
+                    GLuint      texture;
+                    std::vector<node_id> nodes;         // in drawing order
+                    std::vector<draw_command> commands;
+                    size_t      first_slot, slot_count; // part of command_buffer reserved for the batch
+                    bool        dirty;                  // nodes or their instance ranges changed
+                };
+
+                auto add_node(node_kind kind, node_id parent, int x, int y, int w, int h) -> node_id;
+                auto get(node_id id) -> node &;
+                auto instance_count(const node &n) const -> size_t;
+                void allocate_instances(node &n, size_t count);
+                void free_instances(node &n);
+                void reference_image(image_handle image, bool add); // protects the image from eviction
+                void write_instances(node_id id);       // for clip groups: of all contents
+                auto is_shown(node_id id) const -> bool;
+                auto clip_rect(node_id parent) const -> std::array<int, 4>; // w = 0: unclipped
+                auto bounds(const node &n) const -> std::array<int, 4>; // of the visible records; w = 0: none
+                auto state_of(const node &n) const -> std::pair<int, GLuint>; // render mode, texture
+                static auto grid_cell(int coord) -> int;
+                static auto grid_key(int col, int row) -> std::uint64_t;
+                void enter_grid(node_id id, const std::array<int, 4> &bounds);
+                auto batch_window(node_id id) const -> std::pair<int, int>; // first and last batch the node may join
+                auto place(node_id id) -> bool;
+                void unplace(node_id id);
+                void update_placement(node_id id);
+                void form_batches();
+                void upload_commands();
+
+                renderer &rend;
+                std::vector<node> nodes;                // indexed by ID - 1
+                std::vector<instance_record> instances; // CPU copy of instance_buffer
+                std::vector<std::pair<size_t, size_t>> free_ranges;   // first, count
+                std::vector<std::pair<size_t, size_t>> dirty_ranges;  // not yet uploaded
+                std::vector<node_id> touched_nodes;     // records rewritten since the last draw()
+                bool rebuild_batches = false;
+                std::vector<batch> batches;
+                static const int grid_cell_size = 64;
+                std::unordered_map<std::uint64_t, std::vector<node_id>> grid; // cell -> nodes whose bounds touch it
+                GLuint instance_buffer = 0, element_buffer = 0, command_buffer = 0;
+                size_t instance_capacity = 0;           // in records
+                size_t command_capacity = 0;            // in commands
+                scene_statistics stats = { 0, 0, 0, 0, 0 };
             };
 
             // Method implementations -----------------------------------------
 
-            template <bool YAxisDown>
-            renderer<YAxisDown>::renderer() :
-                vertex_buffer(0), index_buffer(0),
-                vertex_shader(0), fragment_shader(0), program(0)
+            template <bool YAxisDown, typename Config>
+            renderer<YAxisDown, Config>::renderer() :
+                renderer(std::make_shared<shared_resources>())
             {
+            }
+
+            template <bool YAxisDown, typename Config>
+            renderer<YAxisDown, Config>::renderer(std::shared_ptr<shared_resources> resources_) :
+                vertex_buffer(0), index_buffer(0), quad_corner_buffer(0), glyph_instance_buffer(0), bulk_instance_buffer(0),
+                resources(std::move(resources_)), vp_width(0), vp_height(0)
+            {
+                assert(resources);
                 text_color = rgba_to_native({0, 0, 0, 1});
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::init()
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::init()
             {
                 // User code is responsible for creating and/or selecting the proper GL context when calling init()
                 // TODO: somehow (optionally) make use of glbinding's context management facilities?
@@ -216,94 +854,304 @@ namespace gpc {
                 std::call_once(flag, []() { glewInit(); });
                 #endif
 
-                // Upload and compile our shader program
-                {
-                    assert(vertex_shader == 0);
-                    vertex_shader = GL(CreateShader, GL_VERTEX_SHADER);
-                    auto code = vertex_code();
-                    if (YAxisDown) code = gpc::gl::insertLinesIntoShaderSource(code, "#define Y_AXIS_DOWN");
-                    // TODO: dispense with the error checking and logging in release builds
-                    auto log = ::gpc::gl::compileShader(vertex_shader, code);
-                    if (!log.empty()) std::cerr << "Vertex shader compilation log:" << std::endl << log << std::endl;
-                }
-                {
-                    assert(fragment_shader == 0);
-                    fragment_shader = GL(CreateShader, GL_FRAGMENT_SHADER);
-                    auto code = fragment_code();
-                    if (YAxisDown) code = gpc::gl::insertLinesIntoShaderSource(code, "#define Y_AXIS_DOWN");
-                    //std::cerr << code << std::endl;
-                    // TODO: dispense with the error checking and logging in release builds
-                    auto log = gpc::gl::compileShader(fragment_shader, code);
-                    if (!log.empty()) std::cerr << "Fragment shader compilation log:" << std::endl << log << std::endl;
-                }
-                assert(program == 0);
-                program = GL(CreateProgram);
-                GL(AttachShader, program, vertex_shader);
-                GL(AttachShader, program, fragment_shader);
-                GL(LinkProgram, program);
-                //GL(ValidateProgram, program);
-                char log[2048];
-                GLsizei len;
-                GL(GetProgramInfoLog, program, 2048, &len, log);
-                if (log[0] != '\0') {
-                    std::cerr << "Shader info log:" << std::endl << log << std::endl;
-                    throw std::runtime_error("gpc::gui::gl::renderer: failed to build shader program");
+                // Upload and compile our shader program, unless another renderer sharing our resources already did
+                if (resources->program == 0) {
+                    {
+                        assert(resources->vertex_shader == 0);
+                        resources->vertex_shader = GLCALL(CreateShader, GL_VERTEX_SHADER);
+                        auto code = vertex_code();
+                        if (YAxisDown) code = gpc::gl::insertLinesIntoShaderSource(code, "#define Y_AXIS_DOWN");
+                        compile_shader(resources->vertex_shader, code, "Vertex shader compilation");
+                    }
+                    {
+                        assert(resources->fragment_shader == 0);
+                        resources->fragment_shader = GLCALL(CreateShader, GL_FRAGMENT_SHADER);
+                        auto code = fragment_code();
+                        if (YAxisDown) code = gpc::gl::insertLinesIntoShaderSource(code, "#define Y_AXIS_DOWN");
+                        //std::cerr << code << std::endl;
+                        compile_shader(resources->fragment_shader, code, "Fragment shader compilation");
+                    }
+                    resources->program = GLCALL(CreateProgram);
+                    GLCALL(AttachShader, resources->program, resources->vertex_shader);
+                    GLCALL(AttachShader, resources->program, resources->fragment_shader);
+                    GLCALL(LinkProgram, resources->program);
+                    //GLCALL(ValidateProgram, program);
+                    if (instrumentation::enabled) {
+                        char log[2048];
+                        GLsizei len = 0;
+                        GLCALL(GetProgramInfoLog, resources->program, 2048, &len, log);
+                        instrumentation::shader_log("Shader program", std::string(log, len));
+                    }
+                    GLint status;
+                    GLCALL(GetProgramiv, resources->program, GL_LINK_STATUS, &status);
+                    if (status == 0) throw std::runtime_error("gpc::gui::gl::renderer: failed to build shader program");
                 }
 
                 // Generate a vertex and an index buffer for rectangle vertices
                 assert(vertex_buffer == 0);
-                GL(GenBuffers, 1, &vertex_buffer);
+                GLCALL(GenBuffers, 1, &vertex_buffer);
                 assert(index_buffer == 0);
-                GL(GenBuffers, 1, &index_buffer);
+                GLCALL(GenBuffers, 1, &index_buffer);
 
                 // Initialize the index buffer
                 static GLushort indices[] = { 0, 1, 3, 2 };
-                GL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-                GL(BufferData, GL_ELEMENT_ARRAY_BUFFER, 4 * sizeof(GLushort), indices, GL_STATIC_DRAW);
+                GLCALL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+                GLCALL(BufferData, GL_ELEMENT_ARRAY_BUFFER, 4 * sizeof(GLushort), indices, GL_STATIC_DRAW);
+
+                // Corners of a unit quad, used as the per-vertex attribute of instanced quads
+                static GLint corners[] = { 0, 0,  1, 0,  0, 1,  1, 1 };
+                assert(quad_corner_buffer == 0);
+                GLCALL(GenBuffers, 1, &quad_corner_buffer);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, quad_corner_buffer);
+                GLCALL(BufferData, GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, 0);
+
+                // Streaming buffer for the per-glyph instance attributes of text runs
+                assert(glyph_instance_buffer == 0);
+                GLCALL(GenBuffers, 1, &glyph_instance_buffer);
+
+                // Streaming buffer for the arrays passed to the bulk submission methods
+                assert(bulk_instance_buffer == 0);
+                GLCALL(GenBuffers, 1, &bulk_instance_buffer);
+
+                resources->memory.allocate(buffer_memory(vertex_buffer), memory_category::streaming, 4 * 2 * sizeof(GLint), "rectangle vertices");
+                resources->memory.allocate(buffer_memory(index_buffer), memory_category::streaming, 4 * sizeof(GLushort), "rectangle indices");
+                resources->memory.allocate(buffer_memory(quad_corner_buffer), memory_category::streaming, sizeof(corners), "quad corners");
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::compile_shader(GLuint shader, const std::string &code, const char *what)
+            {
+                const GLchar *source = code.c_str();
+                GLCALL(ShaderSource, shader, 1, &source, nullptr);
+                GLCALL(CompileShader, shader);
+
+                if (instrumentation::enabled) {
+                    GLint len = 0;
+                    GLCALL(GetShaderiv, shader, GL_INFO_LOG_LENGTH, &len);
+                    if (len > 1) {
+                        std::vector<GLchar> log(len);
+                        GLCALL(GetShaderInfoLog, shader, len, nullptr, &log[0]);
+                        instrumentation::shader_log(what, std::string(&log[0]));
+                    }
+                }
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::cleanup()
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::cleanup()
             {
                 // TODO: free all resources
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::define_viewport(int x, int y, int w, int h)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::define_viewport(int x, int y, int w, int h)
             {
                 vp_width = w, vp_height = h;
-                GL(Viewport, x, y, w, h);
+                GLCALL(Viewport, x, y, w, h);
 
-                GL(UseProgram, program);
+                GLCALL(UseProgram, resources->program);
                 ::gpc::gl::setUniform("viewport_w", 0, w);
                 ::gpc::gl::setUniform("viewport_h", 1, h);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::enter_context()
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::enter_context()
             {
                 // TODO: does all this really belong here, or should there be a one-time init independent of viewport ?
-                GL(BlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                GL(Enable, GL_BLEND);
-                GL(Disable, GL_DEPTH_TEST);
-                GL(UseProgram, program);
+                GLCALL(BlendFunc, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                GLCALL(Enable, GL_BLEND);
+                GLCALL(Disable, GL_DEPTH_TEST);
+                GLCALL(UseProgram, resources->program);
+
+                // The program may be shared with other renderers
+                if (vp_width > 0) {
+                    ::gpc::gl::setUniform("viewport_w", 0, vp_width);
+                    ::gpc::gl::setUniform("viewport_h", 1, vp_height);
+                }
+
+                // Somebody else may have been using the context
+                current_render_mode = -1;
+                bound_image_texture = bound_font_texture = unknown_state;
+                seen_modifications = resources->modifications;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::leave_context()
+            {
+                bind_image_texture(0);
+                bind_font_texture(0);
+                GLCALL(UseProgram, 0);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::use_render_mode(int mode)
+            {
+                if (mode != current_render_mode) {
+                    gpc::gl::setUniform("render_mode", 5, mode);
+                    current_render_mode = mode;
+                    stats.count_state_change();
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::bind_image_texture(GLuint texture)
+            {
+                if (resources->modifications != seen_modifications) {
+                    // Another renderer may have deleted or modified textures we believe to be bound
+                    bound_image_texture = bound_font_texture = unknown_state;
+                    seen_modifications = resources->modifications;
+                }
+
+                if (!resources->evictable_images.empty()) {
+                    auto it = resources->evictable_images.find(texture);
+                    if (it != std::end(resources->evictable_images)) it->second.last_use = ++resources->image_use_clock;
+                }
+
+                if (texture != bound_image_texture) {
+                    GLCALL(BindTexture, GL_TEXTURE_RECTANGLE, texture);
+                    bound_image_texture = texture;
+                    stats.count_state_change();
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::bind_font_texture(GLuint texture)
+            {
+                if (resources->modifications != seen_modifications) {
+                    bound_image_texture = bound_font_texture = unknown_state;
+                    seen_modifications = resources->modifications;
+                }
+
+                if (texture != bound_font_texture) {
+                    GLCALL(ActiveTexture, GL_TEXTURE1);
+                    GLCALL(BindTexture, GL_TEXTURE_BUFFER, texture);
+                    GLCALL(ActiveTexture, GL_TEXTURE0);
+                    bound_font_texture = texture;
+                    stats.count_state_change();
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::begin_frame()
+            {
+                assert(!in_frame);
+
+                // Collect finished frames, then wait if the GPU is too far behind
+                retire_frames(false);
+                while (frames_in_flight.size() >= max_frames_in_flight) retire_frames(true);
+
+                if (resources->memory_budget > 0) enforce_memory_budget();
+
+                auto &frame = current_frame;
+                frame.cpu_begin = std::chrono::steady_clock::now();
+                if (frames_since_clock_sync++ >= clock_sync_interval) {
+                    GLint64 gpu_now;
+                    GLCALL(GetInteger64v, GL_TIMESTAMP, &gpu_now);
+                    gpu_clock_offset = gpu_now - std::chrono::duration_cast<std::chrono::nanoseconds>(frame.cpu_begin.time_since_epoch()).count();
+                    frames_since_clock_sync = 1;
+                }
+
+                for (auto &query : frame.queries) {
+                    if (free_queries.empty()) {
+                        GLCALL(GenQueries, 1, &query);
+                    }
+                    else {
+                        query = free_queries.back();
+                        free_queries.pop_back();
+                    }
+                }
+                GLCALL(QueryCounter, frame.queries[0], GL_TIMESTAMP);
+
+                in_frame = true;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::end_frame()
+            {
+                assert(in_frame);
+
+                auto &frame = current_frame;
+                GLCALL(QueryCounter, frame.queries[1], GL_TIMESTAMP);
+                frame.fence = GLCALL(FenceSync, GL_SYNC_GPU_COMMANDS_COMPLETE, (UnusedMask)0);
+                frame.cpu_submit_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame.cpu_begin).count();
+
+                frames_in_flight.push_back(frame);
+                in_frame = false;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::set_max_frames_in_flight(unsigned count)
+            {
+                assert(count >= 1);
+                max_frames_in_flight = count;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::frame_timing_statistics() const -> frame_timing
+            {
+                return { 
+                    gpu_times.count(), frames_in_flight.size(),
+                    cpu_submit_times.percentile(0.5), cpu_submit_times.percentile(0.99),
+                    gpu_times.percentile(0.5), gpu_times.percentile(0.99),
+                    frame_latencies.percentile(0.5), frame_latencies.percentile(0.99)
+                };
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::leave_context()
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retire_frames(bool wait_for_oldest)
             {
-                GL(UseProgram, 0);
+                static const GLuint64 timeout = 1000000000; // 1 second, in nanoseconds
+
+                while (!frames_in_flight.empty()) {
+
+                    auto &frame = frames_in_flight.front();
+
+                    auto status = GLCALL(ClientWaitSync, frame.fence, 
+                        wait_for_oldest ? GL_SYNC_FLUSH_COMMANDS_BIT : (SyncObjectMask)0, wait_for_oldest ? timeout : 0);
+                    if (status == GL_TIMEOUT_EXPIRED) {
+                        if (wait_for_oldest) continue;
+                        break;
+                    }
+                    if (status == GL_WAIT_FAILED) {
+                        // Nothing is known about the frame's completion: drop it without reading its queries
+                        // (which could block), and don't recycle them either, as they may still be pending
+                        GLCALL(DeleteSync, frame.fence);
+                        GLCALL(DeleteQueries, 2, frame.queries);
+                        frames_in_flight.pop_front();
+                        wait_for_oldest = false;
+                        continue;
+                    }
+
+                    // The fence has been signalled, so the query results are available without stalling
+                    GLuint64 gpu_start, gpu_end;
+                    GLCALL(GetQueryObjectui64v, frame.queries[0], GL_QUERY_RESULT, &gpu_start);
+                    GLCALL(GetQueryObjectui64v, frame.queries[1], GL_QUERY_RESULT, &gpu_end);
+
+                    cpu_submit_times.add(frame.cpu_submit_ms);
+                    gpu_times.add((gpu_end - gpu_start) / 1e6);
+                    auto cpu_begin = std::chrono::duration_cast<std::chrono::nanoseconds>(frame.cpu_begin.time_since_epoch()).count();
+                    frame_latencies.add((static_cast<GLint64>(gpu_end) - gpu_clock_offset - cpu_begin) / 1e6);
+
+                    GLCALL(DeleteSync, frame.fence);
+                    free_queries.push_back(frame.queries[0]);
+                    free_queries.push_back(frame.queries[1]);
+                    frames_in_flight.pop_front();
+
+                    wait_for_oldest = false;
+                }
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::clear(const rgba_norm &color)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::clear(const rgba_norm &color)
             {
-                GL(ClearColor, color.r(), color.g(), color.b(), color.a());
-                GL(Clear, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                if (recording) submit_recorded();
+
+                GLCALL(ClearColor, color.r(), color.g(), color.b(), color.a());
+                GLCALL(Clear, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::draw_rect(int x, int y, int w, int h)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::draw_rect(int x, int y, int w, int h)
             {
                 // Prepare the vertices
                 GLint v[4][2];
@@ -313,103 +1161,122 @@ namespace gpc {
                 v[3][0] = x + w, v[3][1] = y;
 
                 // Now send everything to OpenGL
-                GL(EnableClientState, GL_VERTEX_ARRAY);
-                GL(BindBuffer, GL_ARRAY_BUFFER, vertex_buffer);
-                GL(BufferData, GL_ARRAY_BUFFER, 4 * 2 * sizeof(GLint), v, GL_STATIC_DRAW);
-                GL(VertexPointer, 2, GL_INT, 2 * sizeof(GLint), nullptr);
-                GL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, index_buffer);
-                GL(DrawElements, GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, nullptr);
-                GL(DisableClientState, GL_VERTEX_ARRAY);
-                GL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
-                GL(BindBuffer, GL_ARRAY_BUFFER, 0);
-            }
-
-            template <bool YAxisDown>
-            auto renderer<YAxisDown>::register_rgba32_image(size_t width, size_t height, const rgba32 *pixels) -> image_handle
-            {
-                auto i = image_textures.size();
-                image_textures.resize(i + 1);
-                GL(GenTextures, 1, &image_textures[i]);
-                //GL(ActiveTexture, GL_TEXTURE0);
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, image_textures[i]);
-                GL(TexImage2D, GL_TEXTURE_RECTANGLE, 0, (GLint)GL_RGBA, width, height, 0, (GLenum)GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, 0);
-                return image_textures[i];
-            }
-
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::release_rgba32_image(image_handle hnd)
-            {
-                auto i = std::find(std::begin(image_textures), std::end(image_textures), hnd);
-                assert(i != std::end(image_textures));
-                GL(DeleteTextures, 1, &hnd);
+                GLCALL(EnableClientState, GL_VERTEX_ARRAY);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, vertex_buffer);
+                GLCALL(BufferData, GL_ARRAY_BUFFER, 4 * 2 * sizeof(GLint), v, GL_STATIC_DRAW);
+                GLCALL(VertexPointer, 2, GL_INT, 2 * sizeof(GLint), nullptr);
+                GLCALL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+                GLCALL(DrawElements, GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_SHORT, nullptr);
+                stats.count_draw_call();
+                GLCALL(DisableClientState, GL_VERTEX_ARRAY);
+                GLCALL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, 0);
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::register_rgba32_image(size_t width, size_t height, const rgba32 *pixels) -> image_handle
+            {
+                auto i = resources->image_textures.size();
+                resources->image_textures.resize(i + 1);
+                GLCALL(GenTextures, 1, &resources->image_textures[i]);
+                //GLCALL(ActiveTexture, GL_TEXTURE0);
+                GLCALL(BindTexture, GL_TEXTURE_RECTANGLE, resources->image_textures[i]);
+                GLCALL(TexImage2D, GL_TEXTURE_RECTANGLE, 0, (GLint)GL_RGBA, width, height, 0, (GLenum)GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                GLCALL(BindTexture, GL_TEXTURE_RECTANGLE, 0);
+                bound_image_texture = 0;
+                account_image(resources->image_textures[i], width, height, 4, "RGBA");
+                return resources->image_textures[i];
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::release_rgba32_image(image_handle hnd)
+            {
+                auto i = std::find(std::begin(resources->image_textures), std::end(resources->image_textures), hnd);
+                assert(i != std::end(resources->image_textures));
+                GLCALL(DeleteTextures, 1, &hnd);
+                if (bound_image_texture == hnd) bound_image_texture = 0; // deleting unbinds
+                resources->modifications++;
                 *i = 0; // TODO: put into "recycle" list ?
+                resources->memory.release(texture_memory(hnd));
+                resources->evictable_images.erase(hnd);
             }
 
-            template<bool YAxisDown>
-            inline auto renderer<YAxisDown>::register_mono8_image(size_t width, size_t height, const mono8 *pixels) -> image_handle
+            template <bool YAxisDown, typename Config>
+            inline auto renderer<YAxisDown, Config>::register_mono8_image(size_t width, size_t height, const mono8 *pixels) -> image_handle
             {
-                auto i = image_textures.size();
-                image_textures.resize(i + 1);
-                GL(GenTextures, 1, &image_textures[i]);
-                //GL(ActiveTexture, GL_TEXTURE0);
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, image_textures[i]);
-                GL(TexImage2D, GL_TEXTURE_RECTANGLE, 0, (GLint)GL_ALPHA, width, height, 0, (GLenum)GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, 0);
-                return image_textures[i];
+                auto i = resources->image_textures.size();
+                resources->image_textures.resize(i + 1);
+                GLCALL(GenTextures, 1, &resources->image_textures[i]);
+                //GLCALL(ActiveTexture, GL_TEXTURE0);
+                GLCALL(BindTexture, GL_TEXTURE_RECTANGLE, resources->image_textures[i]);
+                GLCALL(TexImage2D, GL_TEXTURE_RECTANGLE, 0, (GLint)GL_ALPHA, width, height, 0, (GLenum)GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+                GLCALL(BindTexture, GL_TEXTURE_RECTANGLE, 0);
+                bound_image_texture = 0;
+                account_image(resources->image_textures[i], width, height, 1, "mono");
+                return resources->image_textures[i];
             }
 
-            template<bool YAxisDown>
-            inline void renderer<YAxisDown>::release_mono8_image(image_handle hnd)
+            template <bool YAxisDown, typename Config>
+            inline void renderer<YAxisDown, Config>::release_mono8_image(image_handle hnd)
             {
                 release_rgba32_image(hnd); // same resource list
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::fill_rect(int x, int y, int w, int h, const rgba_norm &color)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::fill_rect(int x, int y, int w, int h, const rgba_norm &color)
             {
-                GL(Uniform4fv, 2, 1, color);
-                gpc::gl::setUniform("render_mode", 5, 1);
+                if (recording) {
+                    recorded_rect_params.push_back({ x, y, w, h, color });
+                    return record_command(x, y, w, h, 1, 0, recorded_rects, recorded_rect_params.size() - 1);
+                }
+
+                GLCALL(Uniform4fv, 2, 1, color);
+                use_render_mode(1);
 
                 draw_rect(x, y, w, h);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::draw_image(int x, int y, int w, int h, image_handle image)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::draw_image(int x, int y, int w, int h, image_handle image)
             {
                 draw_image(x, y, w, h, image, 0, 0);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::draw_image(int x, int y, int w, int h, image_handle image, int offset_x, int offset_y)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::draw_image(int x, int y, int w, int h, image_handle image, int offset_x, int offset_y)
             {
                 static const GLfloat black[4] = { 0, 0, 0, 0 };
+                static const GLfloat identity[2][2] = { { 1, 0 }, { 0, 1 } };
 
-                //GL(ActiveTexture, GL_TEXTURE0);
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, image);
+                if (recording) {
+                    recorded_image_params.push_back({ x, y, w, h, image, offset_x, offset_y });
+                    return record_command(x, y, w, h, 2, image, recorded_images, recorded_image_params.size() - 1);
+                }
+
+                //GLCALL(ActiveTexture, GL_TEXTURE0);
+                bind_image_texture(image);
                 gpc::gl::setUniform("color", 2, black);
                 GLint position[2] = { x, y };
                 gpc::gl::setUniform("sampler", 3, 0);
                 gpc::gl::setUniform("position", 4, position);
                 GLint offset[2] = { offset_x, offset_y };
                 gpc::gl::setUniform("offset", 6, offset);
-                gpc::gl::setUniform("render_mode", 5, 2); // 2 = "paste image"
+                gpc::gl::setUniformMatrix2("texcoord_matrix", 10, &identity[0][0]); // may have been rotated
+                use_render_mode(2); // 2 = "paste image"
 
                 draw_rect(x, y, w, h);
-
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, 0);
             }
 
             // TODO: rename to "modulate_greyscale_image()" ?
-            template<bool YAxisDown>
-            inline void renderer<YAxisDown>::modulate_greyscale_image(int x, int y, int w, int h, 
+            template <bool YAxisDown, typename Config>
+            inline void renderer<YAxisDown, Config>::modulate_greyscale_image(int x, int y, int w, int h, 
                 image_handle img, const rgba_norm &color, int offset_x, int offset_y)
             {
                 _draw_greyscale_image(x, y, w, h, img, color, 0, 0, 0, 1, offset_x, offset_y);
             }
 
-            template<bool YAxisDown>
-            inline void renderer<YAxisDown>::draw_greyscale_image_right_righthand(int x, int y, int length, int width, 
+            template <bool YAxisDown, typename Config>
+            inline void renderer<YAxisDown, Config>::draw_greyscale_image_right_righthand(int x, int y, int length, int width, 
                 image_handle img, const rgba_norm &color, int offset_x, int offset_y)
             {
                 _draw_greyscale_image(x, y, length, width, img, color, 
@@ -419,8 +1286,8 @@ namespace gpc {
                     );
             }
 
-            template<bool YAxisDown>
-            inline void renderer<YAxisDown>::draw_greyscale_image_down_righthand(int x, int y, int length, int width, 
+            template <bool YAxisDown, typename Config>
+            inline void renderer<YAxisDown, Config>::draw_greyscale_image_down_righthand(int x, int y, int length, int width, 
                 image_handle img, const rgba_norm &color, int offset_x, int offset_y)
             {
                 _draw_greyscale_image(x - width, y, width, length, img, color, 
@@ -430,8 +1297,8 @@ namespace gpc {
                     );
             }
 
-            template<bool YAxisDown>
-            inline void renderer<YAxisDown>::draw_greyscale_image_left_righthand(int x, int y, int length, int width, 
+            template <bool YAxisDown, typename Config>
+            inline void renderer<YAxisDown, Config>::draw_greyscale_image_left_righthand(int x, int y, int length, int width, 
                 image_handle img, const rgba_norm &color, int offset_x, int offset_y)
             {
                 _draw_greyscale_image(x - length, y - width, length, width, img, color, 
@@ -441,8 +1308,8 @@ namespace gpc {
                     );
             }
 
-            template<bool YAxisDown>
-            inline void renderer<YAxisDown>::draw_greyscale_image_up_righthand(int x, int y, int length, int width, 
+            template <bool YAxisDown, typename Config>
+            inline void renderer<YAxisDown, Config>::draw_greyscale_image_up_righthand(int x, int y, int length, int width, 
                 image_handle img, const rgba_norm &color, int offset_x, int offset_y)
             {
                 _draw_greyscale_image(x, y - length, width, length, img, color, 
@@ -452,16 +1319,21 @@ namespace gpc {
                     );
             }
 
-            template<bool YAxisDown>
-            inline void renderer<YAxisDown>::_draw_greyscale_image(int x, int y, int w, int h, image_handle img, const rgba_norm &color, 
+            template <bool YAxisDown, typename Config>
+            inline void renderer<YAxisDown, Config>::_draw_greyscale_image(int x, int y, int w, int h, image_handle img, const rgba_norm &color, 
                 int origin_x, int origin_y, float texrot_sin, float texrot_cos, int offset_x, int offset_y)
             {
                 using namespace gpc::gl;
 
+                if (recording) {
+                    recorded_greyscale_params.push_back({ x, y, w, h, img, color, origin_x, origin_y, texrot_sin, texrot_cos, offset_x, offset_y });
+                    return record_command(x, y, w, h, 4, img, recorded_greyscale, recorded_greyscale_params.size() - 1);
+                }
+
                 auto native_clr = rgba_to_native(color);
 
-                //GL(ActiveTexture, GL_TEXTURE0);
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, img);
+                //GLCALL(ActiveTexture, GL_TEXTURE0);
+                bind_image_texture(img);
                 setUniform("color", 2, native_clr.components);
                 GLint position[2] = { x + origin_x, y + origin_y };
                 setUniform("sampler", 3, 0);
@@ -470,202 +1342,1813 @@ namespace gpc {
                 setUniform("offset", 6, offset);
                 GLfloat texcoord_matrix[2][2] = { texrot_cos, - texrot_sin, texrot_sin, texrot_cos };
                 setUniformMatrix2("texcoord_matrix", 10, &texcoord_matrix[0][0]);
-                setUniform("render_mode", 5, 4); // 4 = "modulate greyscale image"
+                use_render_mode(4); // 4 = "modulate greyscale image"
 
                 draw_rect(x, y, w, h);
-
-                GL(BindTexture, GL_TEXTURE_RECTANGLE, 0);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::set_clipping_rect(int x, int y, int w, int h)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::fill_rounded_rect(int x, int y, int w, int h, int radius, const rgba_norm &color)
             {
-                #ifdef DEBUG
-                assert(!dbg_clipping_active);
-                #endif
-
-                GL(Scissor, x, YAxisDown ? vp_height - (y + h) : y, w, h);
-                GL(Enable, GL_SCISSOR_TEST);
-
-                #ifdef DEBUG
-                dbg_clipping_active = true;
-                #endif
+                _draw_shape(x, y, w, h, radius, 0, 0, color);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::cancel_clipping()
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::stroke_rounded_rect(int x, int y, int w, int h, int radius, int border_width, const rgba_norm &color)
             {
-                #ifdef DEBUG
-                assert(dbg_clipping_active);
-                dbg_clipping_active = false;
-                #endif
-
-                GL(Disable, GL_SCISSOR_TEST);
+                assert(border_width > 0);
+                _draw_shape(x, y, w, h, radius, border_width, 0, color);
             }
 
-            // TODO: free resources allocated for fonts
-            template <bool YAxisDown>
-            auto renderer<YAxisDown>::register_font(const gpc::fonts::rasterized_font &font) -> font_handle
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::fill_linear_gradient(int x, int y, int w, int h, int radius,
+                int x0, int y0, const rgba_norm &color0, int x1, int y1, const rgba_norm &color1)
             {
-                // TODO: re-use discarded slots
-                font_handle index = managed_fonts.size();
-
-                managed_fonts.emplace_back(managed_font{ font });
-                auto &mf = managed_fonts.back();
-
-                mf.store_pixels();
-                mf.create_quads();
-
-                return index + 1;
+                GLfloat gradient[4] = { (GLfloat) x0, (GLfloat) y0, (GLfloat) x1, (GLfloat) y1 };
+                _draw_shape(x, y, w, h, radius, 0, 0, color0, linear_gradient_paint, gradient, &color1);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::release_font(font_handle /*handle*/)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::fill_radial_gradient(int x, int y, int w, int h, int radius,
+                int cx, int cy, int r, const rgba_norm &inner, const rgba_norm &outer)
             {
-                // auto &font = managed_fonts[handle - 1];
-                // TODO: actual implementation
+                GLfloat gradient[4] = { (GLfloat) cx, (GLfloat) cy, (GLfloat) r, 0 };
+                _draw_shape(x, y, w, h, radius, 0, 0, inner, radial_gradient_paint, gradient, &outer);
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::set_text_color(const rgba_norm &color)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::draw_drop_shadow(int x, int y, int w, int h, int radius, int blur, const rgba_norm &color)
+            {
+                assert(blur > 0);
+                _draw_shape(x, y, w, h, radius, 0, blur, color);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::_draw_shape(int x, int y, int w, int h, int radius, int border_width, int blur,
+                const rgba_norm &color, paint_mode paint, const GLfloat *gradient, const rgba_norm *color2)
+            {
+                using gpc::gl::setUniform;
+
+                if (recording) {
+                    // Copy what the pointers refer to
+                    recorded_shape_params shape = { x, y, w, h, radius, border_width, blur, color, color2 ? *color2 : color, paint, { 0, 0, 0, 0 } };
+                    if (gradient) std::copy(gradient, gradient + 4, shape.gradient);
+                    recorded_shapes.push_back(shape);
+                    return record_command(x - blur, y - blur, w + 2 * blur, h + 2 * blur, 6, 0, recorded_shape, recorded_shapes.size() - 1);
+                }
+
+                GLCALL(Uniform4fv, 2, 1, color);
+                GLCALL(Uniform4f, 12, (GLfloat) x, (GLfloat) y, (GLfloat) w, (GLfloat) h);              // 12 = shape_rect
+                GLCALL(Uniform4f, 13, (GLfloat) radius, (GLfloat) border_width, (GLfloat) blur, 0.0f);  // 13 = shape_params
+                setUniform("paint_mode", 14, static_cast<int>(paint));
+                if (paint != solid_paint) {
+                    GLCALL(Uniform4fv, 15, 1, gradient);
+                    GLCALL(Uniform4fv, 16, 1, *color2);
+                }
+                use_render_mode(6); // 6 = "shape"
+
+                // A blurred shape extends beyond its rectangle
+                draw_rect(x - blur, y - blur, w + 2 * blur, h + 2 * blur);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::set_clipping_rect(int x, int y, int w, int h)
+            {
+                if (recording) submit_recorded();
+
+                if (instrumentation::enabled) {
+                    assert(!dbg_clipping_active);
+                    dbg_clipping_active = true;
+                }
+
+                GLCALL(Scissor, x, YAxisDown ? vp_height - (y + h) : y, w, h);
+                GLCALL(Enable, GL_SCISSOR_TEST);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::cancel_clipping()
+            {
+                if (recording) submit_recorded();
+
+                if (instrumentation::enabled) {
+                    assert(dbg_clipping_active);
+                    dbg_clipping_active = false;
+                }
+
+                GLCALL(Disable, GL_SCISSOR_TEST);
+            }
+
+            // TODO: free resources allocated for fonts
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::register_font(const gpc::fonts::rasterized_font &font, int subpixel_steps) -> font_handle
+            {
+                assert(subpixel_steps >= 1);
+
+                // TODO: re-use discarded slots
+                font_handle index = resources->managed_fonts.size();
+
+                resources->managed_fonts.emplace_back(managed_font{ font, subpixel_steps });
+                auto &mf = resources->managed_fonts.back();
+
+                for (const auto &variant : font.variants) mf.store_pixels(&variant.pixels[0], variant.pixels.size());
+                if (subpixel_steps > 1) mf.cache_size = mf.pixel_bytes;
+
+                mf.account_memory(resources->memory, index + 1);
+                if (resources->memory_budget > 0) enforce_memory_budget();
+
+                return index + 1;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::register_font(const mapped_gpu_font &file) -> font_handle
+            {
+                // TODO: re-use discarded slots
+                font_handle index = resources->managed_fonts.size();
+
+                resources->managed_fonts.emplace_back(managed_font{ file });
+                auto &mf = resources->managed_fonts.back();
+
+                for (auto i = 0U; i < file.header().variant_count; i++) {
+                    mf.store_pixels(file.variant_pixels(i), static_cast<size_t>(file.variant(i).pixels_size));
+                }
+
+                mf.account_memory(resources->memory, index + 1);
+                if (resources->memory_budget > 0) enforce_memory_budget();
+
+                return index + 1;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::register_sdf_font(const gpc::fonts::rasterized_font &font, int spread) -> font_handle
+            {
+                assert(spread >= 1);
+
+                // TODO: re-use discarded slots
+                font_handle index = resources->managed_fonts.size();
+
+                // Only the glyph and codepoint tables are kept: the field replaces the pixels
+                resources->managed_fonts.emplace_back(managed_font{ font, 1, true });
+                auto &mf = resources->managed_fonts.back();
+
+                mf.generate_distance_field(font, spread);
+                mf.store_distance_field();
+
+                mf.account_memory(resources->memory, index + 1);
+                if (resources->memory_budget > 0) enforce_memory_budget();
+
+                return index + 1;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::release_font(font_handle /*handle*/)
+            {
+                // auto &font = managed_fonts[handle - 1];
+                // TODO: actual implementation
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::set_text_color(const rgba_norm &color)
             {
                 text_color = color;
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::render_text(font_handle handle, int x, int y, const char32_t *text, size_t count, int w_max)
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::set_text_variant(int variant)
+            {
+                assert(variant >= 0);
+                text_variant = variant;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::render_text(font_handle handle, int x, int y, const char32_t *text, size_t count, int w_max)
+            {
+                render_text_subpixel(handle, static_cast<float>(x), y, text, count, w_max);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::render_text_subpixel(font_handle handle, float x, int y, const char32_t *text, size_t count, int w_max)
+            {
+                // TODO: support text that advances in Y direction (and right-to-left)
+
+                auto &mfont = resources->managed_fonts[handle - 1];
+
+                if (mfont.sdf_spread > 0) return _render_sdf_text(mfont, x, y, 1, text, count, w_max);
+
+                if (count == 0) return;
+
+                glyph_run.clear();
+                _append_bitmap_glyphs(mfont, x, y, text, count, w_max);
+                _draw_bitmap_glyphs(handle, mfont);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::_append_bitmap_glyphs(managed_font &mfont, float x, int y, 
+                const char32_t *text, size_t count, int w_max)
+            {
+                auto var_index = text_variant;
+                assert(static_cast<size_t>(var_index) < mfont.variant_count);
+                auto steps = mfont.subpixel_steps;
+                // With subpixel steps, all glyphs are taken from the cache, which begins with the variants' pixels
+                auto variant_base = steps > 1 ? static_cast<GLint>(mfont.variant_offset(var_index)) : 0;
+
+                // The pen position is tracked in 1/64 pixels, like the advances (see gpu_font_glyph), so 
+                // that fractional advances accumulate exactly
+                auto origin = static_cast<std::int32_t>(std::lround(x * 64));
+                auto pen = origin - 64 * mfont.glyph(var_index, mfont.find_glyph(*text)).x_min;
+
+                for (const auto *p = text; p < (text + count); p++)
+                {
+                    auto glyph_index = mfont.find_glyph(*p);
+                    const auto &glyph = mfont.glyph(var_index, glyph_index);
+
+                    auto pen_x = static_cast<GLint>(std::floor(pen / 64.0));
+                    auto step = steps > 1 ? ((pen - 64 * pen_x) * steps + 32) / 64 : (pen - 64 * pen_x + 32) / 64;
+                    if (step == steps) step = 0, pen_x++; // without subpixel steps: rounds to the nearest pixel
+
+                    if (step > 0) {
+                        auto cg = mfont.subpixel_glyph(var_index, glyph_index, step);
+                        glyph_run.push_back({ pen_x, y, cg.pixel_base, cg.x_min, cg.x_max, cg.y_min, cg.y_max });
+                    }
+                    else {
+                        glyph_run.push_back({ pen_x, y, variant_base + glyph.pixel_base, glyph.x_min, glyph.x_max, glyph.y_min, glyph.y_max });
+                    }
+
+                    pen += glyph.adv_x;
+
+                    if (w_max > 0 && pen - origin >= 64 * w_max) break;
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::_draw_bitmap_glyphs(font_handle handle, managed_font &mfont)
+            {
+                if (mfont.subpixel_steps <= 1) return draw_glyph_run(mfont.textures[text_variant]);
+
+                auto old_buffer = mfont.cache_buffer;
+                if (!mfont.pending_pixels.empty() || old_buffer == 0) resources->modifications++;
+                mfont.flush_subpixel_cache();
+                if (mfont.cache_buffer != old_buffer) {
+                    if (old_buffer != 0) resources->memory.release(buffer_memory(old_buffer));
+                    mfont.account_memory(resources->memory, handle);
+                }
+                draw_glyph_run(mfont.cache_texture);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::render_text_scaled(font_handle handle, int x, int y, float scale, 
+                const char32_t *text, size_t count, int w_max)
+            {
+                auto &mfont = resources->managed_fonts[handle - 1];
+                assert(mfont.sdf_spread > 0); // only distance field fonts can be scaled
+
+                _render_sdf_text(mfont, static_cast<float>(x), y, scale, text, count, w_max);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::_render_sdf_text(managed_font &mfont, float x, int y, float scale, 
+                const char32_t *text, size_t count, int w_max)
+            {
+                if (count == 0) return;
+
+                glyph_run.clear();
+                _append_sdf_glyphs(mfont, x, y, scale, text, count, w_max);
+                draw_glyph_run(mfont.sdf_texture, 5, scale);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::_append_sdf_glyphs(managed_font &mfont, float x, int y, float scale, 
+                const char32_t *text, size_t count, int w_max)
+            {
+                auto var_index = text_variant;
+                assert(static_cast<size_t>(var_index) < mfont.variant_count);
+
+                float dx = - scale * mfont.glyph(var_index, mfont.find_glyph(*text)).x_min;
+
+                for (const auto *p = text; p < (text + count); p++)
+                {
+                    auto glyph_index = mfont.find_glyph(*p);
+                    const auto &glyph = mfont.glyph(var_index, glyph_index);
+                    const auto &sg = mfont.sdf_glyphs[var_index * mfont.glyph_count + glyph_index];
+
+                    // Pen positions are passed in 1/64 pixels (see vertex.glsl)
+                    auto pen_x = static_cast<GLint>(std::lround((x + dx) * 64));
+                    glyph_run.push_back({ pen_x, 64 * y, sg.pixel_base, sg.x_min, sg.x_max, sg.y_min, sg.y_max });
+
+                    dx += scale * glyph.adv_x / 64.0f;
+
+                    if (w_max > 0 && dx >= w_max) break;
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::render_texts(const text_item *items, size_t count)
+            {
+                auto same_color = [](const rgba_norm &a, const rgba_norm &b) {
+                    const GLfloat *ca = a, *cb = b;
+                    return std::equal(ca, ca + 4, cb);
+                };
+
+                auto saved_color = text_color;
+
+                // Items using the same font and color are drawn as a single glyph run
+                for (size_t first = 0; first < count; ) {
+
+                    auto handle = items[first].font;
+                    auto &mfont = resources->managed_fonts[handle - 1];
+
+                    auto last = first + 1;
+                    while (last < count && items[last].font == handle && same_color(items[last].color, items[first].color)) last++;
+
+                    glyph_run.clear();
+                    for (auto i = first; i < last; i++) {
+                        const auto &item = items[i];
+                        if (item.count == 0) continue;
+                        if (mfont.sdf_spread > 0) {
+                            _append_sdf_glyphs(mfont, static_cast<float>(item.x), item.y, 1, item.text, item.count, item.w_max);
+                        }
+                        else {
+                            _append_bitmap_glyphs(mfont, static_cast<float>(item.x), item.y, item.text, item.count, item.w_max);
+                        }
+                    }
+
+                    if (!glyph_run.empty()) {
+                        text_color = items[first].color;
+                        if (mfont.sdf_spread > 0) draw_glyph_run(mfont.sdf_texture, 5, 1);
+                        else _draw_bitmap_glyphs(handle, mfont);
+                    }
+
+                    first = last;
+                }
+
+                text_color = saved_color;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::font_memory(font_handle handle) const -> font_memory_usage
+            {
+                const auto &mfont = resources->managed_fonts[handle - 1];
+
+                font_memory_usage usage{ mfont.pixel_bytes, mfont.sdf_size, mfont.cache_capacity, mfont.cache_capacity > 0 ? mfont.cache_size : 0 };
+
+                return usage;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::draw_glyph_run(GLuint font_texture, int render_mode, float scale)
+            {
+                using gpc::gl::setUniform;
+
+                if (glyph_run.empty()) return;
+
+                if (recording) {
+                    auto bounds = glyph_run_bounds(render_mode, scale);
+                    recorded_glyph_runs.push_back({ recorded_glyph_instances.size(), glyph_run.size(), text_color, scale });
+                    recorded_glyph_instances.insert(std::end(recorded_glyph_instances), std::begin(glyph_run), std::end(glyph_run));
+                    return record_command(bounds[0], bounds[1], bounds[2], bounds[3], render_mode, font_texture, 
+                        recorded_glyphs, recorded_glyph_runs.size() - 1);
+                }
+
+                // Attribute 0 (vertex position) supplies the quad corner, as 0/1 pairs
+                GLCALL(EnableClientState, GL_VERTEX_ARRAY);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, quad_corner_buffer);
+                GLCALL(VertexPointer, 2, GL_INT, 0, static_cast<GLvoid*>(0));
+
+                // Per-glyph instance attributes; re-specifying the whole buffer lets the driver orphan the old storage
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, glyph_instance_buffer);
+                GLCALL(BufferData, GL_ARRAY_BUFFER, glyph_run.size() * sizeof(glyph_instance), &glyph_run[0], GL_STREAM_DRAW);
+                if (glyph_run.size() * sizeof(glyph_instance) != glyph_instance_bytes) {
+                    glyph_instance_bytes = glyph_run.size() * sizeof(glyph_instance);
+                    resources->memory.allocate(buffer_memory(glyph_instance_buffer), memory_category::streaming, glyph_instance_bytes, "glyph instances");
+                }
+                const GLsizei stride = sizeof(glyph_instance);
+                GLCALL(VertexAttribIPointer, 1, 2, GL_INT, stride, reinterpret_cast<GLvoid*>(offsetof(glyph_instance, x)));
+                GLCALL(VertexAttribIPointer, 2, 1, GL_INT, stride, reinterpret_cast<GLvoid*>(offsetof(glyph_instance, pixel_base)));
+                GLCALL(VertexAttribIPointer, 3, 4, GL_INT, stride, reinterpret_cast<GLvoid*>(offsetof(glyph_instance, x_min)));
+                for (GLuint i = 1; i <= 3; i++) {
+                    GLCALL(EnableVertexAttribArray, i);
+                    GLCALL(VertexAttribDivisor, i, 1);
+                }
+
+                bind_font_texture(font_texture); // font pixels
+
+                GLCALL(Uniform4fv, 2, 1, text_color); // 2 = color
+                use_render_mode(render_mode); // 3 = bitmap glyphs, 5 = distance field glyphs
+                setUniform("font_pixels", 7, 1); // use texture unit 1 to access glyph pixels
+                if (render_mode == 5) GLCALL(Uniform1f, 11, scale); // 11 = glyph_scale
+
+                // One draw for the whole run
+                GLCALL(DrawArraysInstanced, GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(glyph_run.size()));
+                stats.count_draw_call();
+
+                for (GLuint i = 1; i <= 3; i++) {
+                    GLCALL(VertexAttribDivisor, i, 0);
+                    GLCALL(DisableVertexAttribArray, i);
+                }
+                GLCALL(DisableClientState, GL_VERTEX_ARRAY);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, 0);
+            }
+
+            // Memory accounting ----------------------------------------------
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::account_image(image_handle image, size_t width, size_t height, 
+                size_t bytes_per_pixel, const char *format)
+            {
+                resources->memory.allocate(texture_memory(image), memory_category::images, width * height * bytes_per_pixel,
+                    "image " + std::to_string(image) + " (" + std::to_string(width) + "x" + std::to_string(height) + " " + format + ")");
+
+                if (resources->memory_budget > 0) enforce_memory_budget();
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::gpu_memory() const -> gpu_memory_usage
+            {
+                return { 
+                    resources->memory.total(memory_category::images), resources->memory.total(memory_category::fonts),
+                    resources->memory.total(memory_category::streaming), resources->memory.total(memory_category::layers),
+                    resources->memory.total(), resources->memory.peak(), resources->memory_budget
+                };
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::dump_gpu_memory(std::ostream &os, size_t count) const
+            {
+                resources->memory.dump(os, count);
+                if (resources->memory_budget > 0) os << "  budget " << resources->memory_budget << " bytes" << std::endl;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::set_memory_budget(size_t bytes, budget_callback budget_exceeded_)
+            {
+                resources->memory_budget = bytes;
+                resources->budget_exceeded = std::move(budget_exceeded_);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::make_image_evictable(image_handle image, eviction_callback on_evicted)
+            {
+                assert(std::find(std::begin(resources->image_textures), std::end(resources->image_textures), image) != std::end(resources->image_textures));
+
+                resources->evictable_images[image] = { std::move(on_evicted), ++resources->image_use_clock }; // counts as a use
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::enforce_memory_budget()
+            {
+                // Recorded commands may refer to anything we could release; eviction callbacks may register 
+                // resources again
+                if (resources->memory_budget == 0 || resources->recording_renderers > 0 || resources->enforcing_budget) return;
+                resources->enforcing_budget = true;
+
+                // Subpixel glyph caches, largest first
+                while (resources->memory.total() > resources->memory_budget) {
+                    auto largest = std::max_element(std::begin(resources->managed_fonts), std::end(resources->managed_fonts),
+                        [](const managed_font &a, const managed_font &b) { return a.cache_capacity < b.cache_capacity; });
+                    if (largest == std::end(resources->managed_fonts) || largest->cache_capacity == 0) break;
+                    resources->memory.release(buffer_memory(largest->cache_buffer));
+                    largest->discard_subpixel_cache();
+                    resources->modifications++;
+                }
+
+                // Evictable images not used by a retained scene, least recently drawn first
+                while (resources->memory.total() > resources->memory_budget) {
+                    auto oldest = std::end(resources->evictable_images);
+                    for (auto it = std::begin(resources->evictable_images); it != std::end(resources->evictable_images); ++it) {
+                        if (resources->scene_image_refs.count(it->first) > 0) continue;
+                        if (oldest == std::end(resources->evictable_images) || it->second.last_use < oldest->second.last_use) oldest = it;
+                    }
+                    if (oldest == std::end(resources->evictable_images)) break;
+                    auto image = oldest->first;
+                    auto on_evicted = std::move(oldest->second.on_evicted);
+                    release_rgba32_image(image); // also removes it from the evictable images
+                    if (on_evicted) on_evicted(image);
+                }
+
+                if (resources->memory.total() > resources->memory_budget && resources->budget_exceeded) resources->budget_exceeded(resources->memory.total() - resources->memory_budget);
+
+                resources->enforcing_budget = false;
+            }
+
+            // Bulk submission ------------------------------------------------
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::fill_rects(const rect_color *rects, size_t count)
+            {
+                if (count == 0) return;
+
+                if (recording) {
+                    // Recorded as a whole, covering the union of the rectangles
+                    auto first = recorded_rect_params.size();
+                    recorded_rect_params.insert(std::end(recorded_rect_params), rects, rects + count);
+                    auto bounds = union_bounds(rects, count);
+                    return record_command(bounds[0], bounds[1], bounds[2], bounds[3], 7, 0, recorded_rects, first, count);
+                }
+
+                static_assert(sizeof(rgba_norm) == 4 * sizeof(GLfloat), "rgba_norm must consist of 4 floats");
+
+                upload_instances(rects, count * sizeof(rect_color));
+                GLCALL(VertexAttribIPointer, 4, 4, GL_INT, sizeof(rect_color), reinterpret_cast<void*>(offsetof(rect_color, x)));
+                GLCALL(VertexAttribPointer, 5, 4, GL_FLOAT, GL_FALSE, sizeof(rect_color), reinterpret_cast<void*>(offsetof(rect_color, color)));
+
+                _fill_rect_instances(count);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::fill_rects(const GLint *rects, const rgba_norm *colors, size_t count)
+            {
+                if (count == 0) return;
+
+                if (recording) {
+                    // The recorded form is the interleaved one
+                    std::vector<rect_color> interleaved(count);
+                    for (auto i = 0U; i < count; i++) interleaved[i] = { rects[4 * i], rects[4 * i + 1], rects[4 * i + 2], rects[4 * i + 3], colors[i] };
+                    return fill_rects(interleaved.data(), count);
+                }
+
+                auto rects_size = count * 4 * sizeof(GLint);
+                upload_instances(nullptr, rects_size + count * sizeof(rgba_norm));
+                upload_instance_section(0, rects, rects_size);
+                upload_instance_section(rects_size, colors, count * sizeof(rgba_norm));
+                GLCALL(VertexAttribIPointer, 4, 4, GL_INT, 0, nullptr);
+                GLCALL(VertexAttribPointer, 5, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<void*>(rects_size));
+
+                _fill_rect_instances(count);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::_fill_rect_instances(size_t count)
+            {
+                GLCALL(EnableVertexAttribArray, 4);
+                GLCALL(EnableVertexAttribArray, 5);
+                GLCALL(VertexAttribDivisor, 4, 1);
+                GLCALL(VertexAttribDivisor, 5, 1);
+
+                use_render_mode(7); // 7 = "fill instanced rectangles"
+
+                GLCALL(DrawArraysInstanced, GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(count));
+                stats.count_draw_call();
+
+                for (GLuint i = 4; i <= 5; i++) {
+                    GLCALL(VertexAttribDivisor, i, 0);
+                    GLCALL(DisableVertexAttribArray, i);
+                }
+                GLCALL(DisableClientState, GL_VERTEX_ARRAY);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, 0);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::draw_images(const image_instance *images, size_t count)
+            {
+                if (count == 0) return;
+
+                if (recording) {
+                    // One command per run of instances showing the same image, covering the union of the run
+                    for (size_t first = 0; first < count; ) {
+                        auto last = first + 1;
+                        while (last < count && images[last].image == images[first].image) last++;
+
+                        auto arena_first = recorded_image_params.size();
+                        recorded_image_params.insert(std::end(recorded_image_params), images + first, images + last);
+                        auto bounds = union_bounds(images + first, last - first);
+                        record_command(bounds[0], bounds[1], bounds[2], bounds[3], 8, images[first].image, recorded_images, arena_first, last - first);
+
+                        first = last;
+                    }
+                    return;
+                }
+
+                upload_instances(images, count * sizeof(image_instance));
+                GLCALL(VertexAttribIPointer, 4, 4, GL_INT, sizeof(image_instance), reinterpret_cast<void*>(offsetof(image_instance, x)));
+                GLCALL(VertexAttribIPointer, 6, 2, GL_INT, sizeof(image_instance), reinterpret_cast<void*>(offsetof(image_instance, offset_x)));
+                GLCALL(EnableVertexAttribArray, 6);
+                GLCALL(VertexAttribDivisor, 6, 1);
+
+                _draw_image_instances(count, [images](size_t i) { return images[i].image; });
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::draw_images(const GLint *rects, const image_handle *images, const GLint *offsets, size_t count)
+            {
+                if (count == 0) return;
+
+                if (recording) {
+                    // The recorded form is the interleaved one
+                    std::vector<image_instance> interleaved(count);
+                    for (auto i = 0U; i < count; i++) {
+                        interleaved[i] = { rects[4 * i], rects[4 * i + 1], rects[4 * i + 2], rects[4 * i + 3], images[i],
+                            offsets ? offsets[2 * i] : 0, offsets ? offsets[2 * i + 1] : 0 };
+                    }
+                    return draw_images(interleaved.data(), count);
+                }
+
+                auto rects_size = count * 4 * sizeof(GLint);
+                upload_instances(nullptr, rects_size + (offsets ? count * 2 * sizeof(GLint) : 0));
+                upload_instance_section(0, rects, rects_size);
+                GLCALL(VertexAttribIPointer, 4, 4, GL_INT, 0, nullptr);
+                if (offsets) {
+                    upload_instance_section(rects_size, offsets, count * 2 * sizeof(GLint));
+                    GLCALL(VertexAttribIPointer, 6, 2, GL_INT, 0, reinterpret_cast<void*>(rects_size));
+                    GLCALL(EnableVertexAttribArray, 6);
+                    GLCALL(VertexAttribDivisor, 6, 1);
+                }
+                else {
+                    GLCALL(VertexAttribI2i, 6, 0, 0);
+                }
+
+                _draw_image_instances(count, [images](size_t i) { return images[i]; });
+            }
+
+            template <bool YAxisDown, typename Config>
+            template <typename ImageAt>
+            void renderer<YAxisDown, Config>::_draw_image_instances(size_t count, ImageAt image_at)
+            {
+                GLCALL(EnableVertexAttribArray, 4);
+                GLCALL(VertexAttribDivisor, 4, 1);
+
+                use_render_mode(8); // 8 = "paste instanced images"
+
+                // One draw per run of instances showing the same image
+                for (size_t first = 0; first < count; ) {
+                    auto last = first + 1;
+                    while (last < count && image_at(last) == image_at(first)) last++;
+
+                    bind_image_texture(image_at(first));
+                    GLCALL(DrawArraysInstancedBaseInstance, GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(last - first), static_cast<GLuint>(first));
+                    stats.count_draw_call();
+
+                    first = last;
+                }
+
+                for (GLuint i : { 4, 6 }) {
+                    GLCALL(VertexAttribDivisor, i, 0);
+                    GLCALL(DisableVertexAttribArray, i);
+                }
+                GLCALL(DisableClientState, GL_VERTEX_ARRAY);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, 0);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::upload_instances(const void *data, size_t size)
+            {
+                // Attribute 0 (vertex position) supplies the corners of the unit quad
+                GLCALL(EnableClientState, GL_VERTEX_ARRAY);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, quad_corner_buffer);
+                GLCALL(VertexPointer, 2, GL_INT, 2 * sizeof(GLint), nullptr);
+
+                // Re-specifying the streaming buffer orphans its previous storage
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, bulk_instance_buffer);
+                GLCALL(BufferData, GL_ARRAY_BUFFER, size, data, GL_STREAM_DRAW);
+                GLCALL(VertexAttribI4i, 7, 0, 0, 0, 0); // no clipping (see retained_scene)
+                if (size != bulk_instance_bytes) {
+                    bulk_instance_bytes = size;
+                    resources->memory.allocate(buffer_memory(bulk_instance_buffer), memory_category::streaming, size, "bulk instances");
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::upload_instance_section(size_t byte_offset, const void *data, size_t size)
+            {
+                GLCALL(BufferSubData, GL_ARRAY_BUFFER, byte_offset, size, data);
+            }
+
+            // Sorted submission ----------------------------------------------
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::begin_sorted()
+            {
+                assert(!recording);
+
+                recording = true;
+                resources->recording_renderers++;
+                sort_stats = { 0, 0, 0 };
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::end_sorted()
+            {
+                assert(recording);
+
+                submit_recorded();
+                recording = false;
+                resources->recording_renderers--;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::set_layer(int layer)
+            {
+                current_layer = layer;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::record_command(int x, int y, int w, int h, int render_mode, GLuint texture, 
+                recorded_kind kind, size_t first, size_t count)
+            {
+                recorded_commands.push_back({ current_layer, x, y, w, h, render_mode, texture, kind, first, count });
+            }
+
+            template <bool YAxisDown, typename Config>
+            template <typename Instance>
+            auto renderer<YAxisDown, Config>::union_bounds(const Instance *instances, size_t count) -> std::array<int, 4>
+            {
+                auto x_min = std::numeric_limits<int>::max(), y_min = x_min;
+                auto x_max = std::numeric_limits<int>::lowest(), y_max = x_max;
+                for (auto i = 0U; i < count; i++) {
+                    const auto &inst = instances[i];
+                    x_min = std::min(x_min, inst.x), x_max = std::max(x_max, inst.x + inst.w);
+                    y_min = std::min(y_min, inst.y), y_max = std::max(y_max, inst.y + inst.h);
+                }
+
+                return {{ x_min, y_min, x_max - x_min, y_max - y_min }};
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::glyph_run_bounds(int render_mode, float scale) const -> std::array<int, 4>
+            {
+                // Distance field runs have their pen positions in 1/64 pixels
+                auto unit = render_mode == 5 ? 64.0f : 1.0f;
+
+                float x_min = std::numeric_limits<float>::max(), y_min = x_min;
+                float x_max = std::numeric_limits<float>::lowest(), y_max = x_max;
+                for (const auto &glyph : glyph_run) {
+                    float x = glyph.x / unit, y = glyph.y / unit;
+                    float top = YAxisDown ? y - scale * glyph.y_max : y + scale * glyph.y_min;
+                    float bottom = YAxisDown ? y - scale * glyph.y_min : y + scale * glyph.y_max;
+                    x_min = std::min(x_min, x + scale * glyph.x_min), x_max = std::max(x_max, x + scale * glyph.x_max);
+                    y_min = std::min(y_min, top), y_max = std::max(y_max, bottom);
+                }
+
+                auto x0 = static_cast<int>(std::floor(x_min)), y0 = static_cast<int>(std::floor(y_min));
+                return {{ x0, y0, static_cast<int>(std::ceil(x_max)) - x0, static_cast<int>(std::ceil(y_max)) - y0 }};
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::execute_recorded(const recorded_command &command)
+            {
+                switch (command.kind) {
+                case recorded_rects: {
+                    const auto &rect = recorded_rect_params[command.first];
+                    if (command.render_mode == 1) fill_rect(rect.x, rect.y, rect.w, rect.h, rect.color);
+                    else fill_rects(&rect, command.count);
+                    break;
+                }
+                case recorded_images: {
+                    const auto &img = recorded_image_params[command.first];
+                    if (command.render_mode == 2) draw_image(img.x, img.y, img.w, img.h, img.image, img.offset_x, img.offset_y);
+                    else draw_images(&img, command.count);
+                    break;
+                }
+                case recorded_greyscale: {
+                    const auto &p = recorded_greyscale_params[command.first];
+                    _draw_greyscale_image(p.x, p.y, p.w, p.h, p.img, p.color, p.origin_x, p.origin_y, p.texrot_sin, p.texrot_cos, p.offset_x, p.offset_y);
+                    break;
+                }
+                case recorded_shape: {
+                    const auto &p = recorded_shapes[command.first];
+                    _draw_shape(p.x, p.y, p.w, p.h, p.radius, p.border_width, p.blur, p.color, p.paint, p.gradient, &p.color2);
+                    break;
+                }
+                case recorded_glyphs: {
+                    const auto &run = recorded_glyph_runs[command.first];
+                    auto saved_color = text_color;
+                    auto glyphs = std::begin(recorded_glyph_instances) + run.first;
+                    glyph_run.assign(glyphs, glyphs + run.count);
+                    text_color = run.color;
+                    draw_glyph_run(command.texture, command.render_mode, run.scale);
+                    text_color = saved_color;
+                    break;
+                }
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::submit_recorded()
+            {
+                auto &commands = recorded_commands;
+                if (commands.empty()) return;
+
+                auto same_state = [](const recorded_command &a, const recorded_command &b) {
+                    return a.render_mode == b.render_mode && a.texture == b.texture;
+                };
+
+                // State changes as called
+                sort_stats.commands += commands.size();
+                sort_stats.state_changes_before++;
+                for (auto i = 1U; i < commands.size(); i++) {
+                    if (!same_state(commands[i - 1], commands[i])) sort_stats.state_changes_before++;
+                }
+
+                std::stable_sort(std::begin(commands), std::end(commands), 
+                    [](const recorded_command &a, const recorded_command &b) { return a.layer < b.layer; });
+
+                // Overlaps are tracked on a coarse grid laid over everything recorded: each cell holds the 
+                // latest batch that touches it. Sharing a cell counts as overlapping.
+                auto x_min = std::numeric_limits<int>::max(), y_min = x_min;
+                auto x_max = std::numeric_limits<int>::lowest(), y_max = x_max;
+                for (const auto &cmd : commands) {
+                    if (cmd.w <= 0 || cmd.h <= 0) continue;
+                    x_min = std::min(x_min, cmd.x), x_max = std::max(x_max, cmd.x + cmd.w);
+                    y_min = std::min(y_min, cmd.y), y_max = std::max(y_max, cmd.y + cmd.h);
+                }
+                static const int min_cell_size = 32, max_cells = 64; // per axis
+                auto extent = x_max > x_min ? std::max(x_max - x_min, y_max - y_min) : 0;
+                auto cell_size = std::max(min_cell_size, (extent + max_cells - 1) / max_cells);
+                auto cols = extent / cell_size + 1, rows = cols;
+                placement_grid.assign(cols * rows, -1);
+
+                // Each command must come after the last batch it overlaps; among the batches from there 
+                // on, it joins the first that has the same state, or starts a new one at the end
+                batches_by_state.clear();
+                std::vector<int> batch_of(commands.size());
+                int batch_count = 0;
+                for (auto i = 0U; i < commands.size(); i++) {
+
+                    const auto &cmd = commands[i];
+                    auto empty = cmd.w <= 0 || cmd.h <= 0;
+                    int c0 = 0, c1 = -1, r0 = 0, r1 = -1;
+                    if (!empty) {
+                        c0 = (cmd.x - x_min) / cell_size, c1 = (cmd.x + cmd.w - 1 - x_min) / cell_size;
+                        r0 = (cmd.y - y_min) / cell_size, r1 = (cmd.y + cmd.h - 1 - y_min) / cell_size;
+                    }
+
+                    int earliest = 0;
+                    for (auto r = r0; r <= r1; r++) {
+                        for (auto c = c0; c <= c1; c++) earliest = std::max(earliest, placement_grid[r * cols + c]);
+                    }
+
+                    auto &candidates = batches_by_state[(std::uint64_t(cmd.render_mode) << 32) | cmd.texture];
+                    auto it = std::lower_bound(std::begin(candidates), std::end(candidates), static_cast<size_t>(earliest));
+                    int b;
+                    if (it != std::end(candidates)) b = static_cast<int>(*it);
+                    else {
+                        b = batch_count++;
+                        candidates.push_back(b);
+                    }
+                    batch_of[i] = b;
+
+                    for (auto r = r0; r <= r1; r++) {
+                        for (auto c = c0; c <= c1; c++) placement_grid[r * cols + c] = std::max(placement_grid[r * cols + c], b);
+                    }
+                }
+
+                sort_stats.state_changes_after += batch_count;
+
+                // Order by batch, keeping the call order within each batch
+                std::vector<size_t> starts(batch_count + 1, 0);
+                for (auto b : batch_of) starts[b + 1]++;
+                for (auto b = 0; b < batch_count; b++) starts[b + 1] += starts[b];
+                recorded_order.resize(commands.size());
+                for (auto i = 0U; i < commands.size(); i++) recorded_order[starts[batch_of[i]]++] = i;
+
+                // Execute (with recording suspended, the commands draw immediately)
+                recording = false;
+                for (auto i : recorded_order) execute_recorded(commands[i]);
+                recording = true;
+
+                commands.clear();
+                recorded_rect_params.clear(), recorded_image_params.clear(), recorded_greyscale_params.clear();
+                recorded_shapes.clear(), recorded_glyph_runs.clear(), recorded_glyph_instances.clear();
+            }
+
+            // Retained scene -------------------------------------------------
+
+            template <bool YAxisDown, typename Config>
+            renderer<YAxisDown, Config>::retained_scene::retained_scene(renderer &rend_) :
+                rend(rend_)
             {
-                // TODO: support text that advances in Y direction (and right-to-left)
+                // Triangle strip over the corners of the unit quad (see init())
+                static const GLushort indices[] = { 0, 1, 2, 3 };
 
-                using gpc::gl::setUniform;
+                GLCALL(GenBuffers, 1, &element_buffer);
+                GLCALL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+                GLCALL(BufferData, GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+                GLCALL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
+                rend.resources->memory.allocate(buffer_memory(element_buffer), memory_category::streaming, sizeof(indices), "scene quad indices");
+
+                GLCALL(GenBuffers, 1, &instance_buffer);
+                GLCALL(GenBuffers, 1, &command_buffer);
+            }
+
+            template <bool YAxisDown, typename Config>
+            renderer<YAxisDown, Config>::retained_scene::~retained_scene()
+            {
+                for (const auto &n : nodes) if (n.kind == node_kind::image) reference_image(n.image, false);
 
-                const auto &mfont = managed_fonts[handle - 1];
+                for (auto buffer : { element_buffer, instance_buffer, command_buffer }) {
+                    rend.resources->memory.release(buffer_memory(buffer));
+                    GLCALL(DeleteBuffers, 1, &buffer);
+                }
+            }
 
-                auto var_index = 0; // TODO: support multiple variants
-                const auto &variant = mfont.variants[var_index]; 
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::add_rect(int x, int y, int w, int h, const rgba_norm &color, 
+                node_id parent) -> node_id
+            {
+                auto id = add_node(node_kind::rect, parent, x, y, w, h);
+                get(id).color = color;
+                allocate_instances(get(id), 1);
+                write_instances(id);
 
-                GL(EnableClientState, GL_VERTEX_ARRAY);
-                GL(BindBuffer, GL_ARRAY_BUFFER, mfont.vertex_buffer);
-                GL(VertexPointer, 2, GL_INT, 0, static_cast<GLvoid*>(0));
+                return id;
+            }
 
-                GL(BindTexture, GL_TEXTURE_BUFFER, mfont.textures[var_index]); // font pixels
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::add_image(int x, int y, int w, int h, image_handle image, 
+                int offset_x, int offset_y, node_id parent) -> node_id
+            {
+                auto id = add_node(node_kind::image, parent, x, y, w, h);
+                auto &n = get(id);
+                n.image = image, n.offset_x = offset_x, n.offset_y = offset_y;
+                reference_image(image, true);
+                allocate_instances(n, 1);
+                write_instances(id);
+
+                return id;
+            }
 
-                int dx = 0;
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::add_text(font_handle font, int x, int y, const char32_t *text, size_t count, 
+                const rgba_norm &color, node_id parent) -> node_id
+            {
+                assert(rend.resources->managed_fonts[font - 1].sdf_spread == 0); // bitmap fonts only
 
-                auto glyph_index = mfont.find_glyph(*text);
-                auto glyph = & variant.glyphs[glyph_index];
-                dx -= glyph->cbox.bounds.x_min;
+                auto id = add_node(node_kind::text, parent, x, y, 0, 0);
+                auto &n = get(id);
+                n.font = font, n.color = color;
+                n.variant = rend.text_variant;
+                n.text.assign(text, count);
+                allocate_instances(n, count);
+                write_instances(id);
 
-                GL(Uniform4fv, 2, 1, text_color); // 2 = color
-                setUniform("render_mode", 5, 3);
-                setUniform("font_pixels", 7, 0); // use texture unit 0 to access glyph pixels
+                return id;
+            }
 
-                for (const auto *p = text; p < (text + count); p++)
-                {
-                    glyph_index = mfont.find_glyph(*p);
-                    glyph = & variant.glyphs[glyph_index];
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::add_clip_group(int x, int y, int w, int h, node_id parent) -> node_id
+            {
+                return add_node(node_kind::clip_group, parent, x, y, w, h);
+            }
 
-                    setUniform("glyph_base", 8, glyph->pixel_base);
-                    GLint cbox[4] = { 
-                        glyph->cbox.bounds.x_min, glyph->cbox.bounds.x_max, 
-                        glyph->cbox.bounds.y_min, glyph->cbox.bounds.y_max };
-                    setUniform("glyph_cbox", 9, cbox);
-                    GLint position[2] = { x + dx, y };
-                    setUniform("position", 4, position);
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::set_position(node_id id, int x, int y)
+            {
+                auto &n = get(id);
+                n.x = x, n.y = y;
+                write_instances(id);
+            }
 
-                    GLint base = 4 * glyph_index;
-                    GL(DrawArrays, GL_QUADS, base, 4);
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::set_size(node_id id, int w, int h)
+            {
+                auto &n = get(id);
+                assert(n.kind != node_kind::text);
+                n.w = w, n.h = h;
+                write_instances(id);
+            }
 
-                    dx += glyph->cbox.adv_x;
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::set_color(node_id id, const rgba_norm &color)
+            {
+                auto &n = get(id);
+                assert(n.kind == node_kind::rect || n.kind == node_kind::text);
+                n.color = color;
+                write_instances(id);
+            }
 
-                    if (w_max > 0 && dx >= w_max) break;
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::set_image(node_id id, image_handle image, int offset_x, int offset_y)
+            {
+                auto &n = get(id);
+                assert(n.kind == node_kind::image);
+                reference_image(image, true);
+                reference_image(n.image, false);
+                n.image = image, n.offset_x = offset_x, n.offset_y = offset_y;
+                write_instances(id);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::set_text(node_id id, const char32_t *text, size_t count)
+            {
+                auto &n = get(id);
+                assert(n.kind == node_kind::text);
+
+                // With the same number of glyphs, the records are rewritten in place
+                if (count != n.count) {
+                    free_instances(n);
+                    allocate_instances(n, count);
+                }
+                n.text.assign(text, count);
+                write_instances(id);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::set_visible(node_id id, bool visible)
+            {
+                auto &n = get(id);
+                if (visible == n.visible) return;
+                n.visible = visible;
+                write_instances(id);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::remove(node_id id)
+            {
+                auto &n = get(id);
+
+                while (!n.children.empty()) remove(n.children.back());
+
+                if (n.parent != 0) {
+                    auto &siblings = get(n.parent).children;
+                    siblings.erase(std::remove(std::begin(siblings), std::end(siblings), id), std::end(siblings));
+                }
+
+                free_instances(n);
+                unplace(id);
+                enter_grid(id, {{ 0, 0, 0, 0 }});
+                if (n.kind == node_kind::image) reference_image(n.image, false);
+                n.kind = node_kind::removed;
+                n.text.clear();
+                stats.nodes--;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::add_node(node_kind kind, node_id parent, int x, int y, int w, int h) -> node_id
+            {
+                assert(parent == 0 || get(parent).kind == node_kind::clip_group);
+
+                node n{}; // the rest is set by the caller
+                n.kind = kind, n.parent = parent, n.visible = true;
+                n.x = x, n.y = y, n.w = w, n.h = h;
+                n.batch = -1;
+                nodes.push_back(std::move(n));
+
+                auto id = static_cast<node_id>(nodes.size());
+                if (parent != 0) get(parent).children.push_back(id);
+
+                stats.nodes++;
+
+                return id;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::get(node_id id) -> node &
+            {
+                assert(id > 0 && id <= nodes.size() && nodes[id - 1].kind != node_kind::removed);
+
+                return nodes[id - 1];
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::allocate_instances(node &n, size_t count)
+            {
+                n.first = 0, n.count = count;
+                if (count == 0) return;
+
+                stats.instances += count;
+                if (n.batch >= 0) batches[n.batch].dirty = true;
+
+                // First fit among the ranges given up by removed or shrunk nodes
+                for (auto it = std::begin(free_ranges); it != std::end(free_ranges); ++it) {
+                    if (it->second >= count) {
+                        n.first = it->first;
+                        it->first += count, it->second -= count;
+                        if (it->second == 0) free_ranges.erase(it);
+                        return;
+                    }
+                }
+
+                n.first = instances.size();
+                instances.resize(instances.size() + count);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::free_instances(node &n)
+            {
+                if (n.count == 0) return;
+
+                stats.instances -= n.count;
+                if (n.batch >= 0) batches[n.batch].dirty = true;
+
+                // Keep the free list sorted and coalesced
+                auto it = std::lower_bound(std::begin(free_ranges), std::end(free_ranges), std::make_pair(n.first, n.count));
+                it = free_ranges.insert(it, { n.first, n.count });
+                if (it + 1 != std::end(free_ranges) && it->first + it->second == (it + 1)->first) {
+                    it->second += (it + 1)->second;
+                    free_ranges.erase(it + 1);
+                }
+                if (it != std::begin(free_ranges) && (it - 1)->first + (it - 1)->second == it->first) {
+                    (it - 1)->second += it->second;
+                    free_ranges.erase(it);
+                }
+
+                n.first = 0, n.count = 0;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::reference_image(image_handle image, bool add)
+            {
+                auto &refs = rend.resources->scene_image_refs;
+
+                if (add) refs[image]++;
+                else if (--refs[image] == 0) refs.erase(image);
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::is_shown(node_id id) const -> bool
+            {
+                for (; id != 0; id = nodes[id - 1].parent) {
+                    if (!nodes[id - 1].visible) return false;
+                }
+
+                return true;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::clip_rect(node_id parent) const -> std::array<int, 4>
+            {
+                if (parent == 0) return {{ 0, 0, 0, 0 }};
+
+                const auto &group = nodes[parent - 1];
+                int x0 = group.x, y0 = group.y, x1 = group.x + group.w, y1 = group.y + group.h;
+                for (auto id = group.parent; id != 0; id = nodes[id - 1].parent) {
+                    const auto &outer = nodes[id - 1];
+                    x0 = std::max(x0, outer.x), y0 = std::max(y0, outer.y);
+                    x1 = std::min(x1, outer.x + outer.w), y1 = std::min(y1, outer.y + outer.h);
+                }
+
+                if (x1 <= x0 || y1 <= y0) return {{ 0, 0, -1, -1 }}; // nothing visible
+
+                return {{ x0, y0, x1 - x0, y1 - y0 }};
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::write_instances(node_id id)
+            {
+                auto &n = get(id);
+
+                if (n.kind == node_kind::clip_group) {
+                    for (auto child : n.children) write_instances(child);
+                    return;
+                }
+
+                touched_nodes.push_back(id);
+
+                if (n.count == 0) return;
+
+                auto clip = clip_rect(n.parent);
+                auto shown = is_shown(id) && clip[2] >= 0;
+                const GLfloat *color = n.color;
+
+                auto write = [&](instance_record &rec, int x, int y, int w, int h, int offset_x, int offset_y) {
+                    rec.x = x, rec.y = y;
+                    rec.w = shown ? w : 0, rec.h = shown ? h : 0;
+                    std::copy(color, color + 4, rec.color);
+                    rec.offset_x = offset_x, rec.offset_y = offset_y;
+                    rec.clip_x = clip[0], rec.clip_y = clip[1], rec.clip_w = clip[2], rec.clip_h = clip[3];
+                };
+
+                if (n.kind == node_kind::text) {
+
+                    const auto &mfont = rend.resources->managed_fonts[n.font - 1];
+                    auto var_index = n.variant;
+
+                    // Same placement as render_text() without subpixel steps (advances are in 1/64 pixels), 
+                    // see also vertex.glsl
+                    auto pen = - 64 * mfont.glyph(var_index, mfont.find_glyph(n.text[0])).x_min;
+                    for (auto i = 0U; i < n.count; i++) {
+                        const auto &glyph = mfont.glyph(var_index, mfont.find_glyph(n.text[i]));
+                        auto pen_x = n.x + static_cast<int>(std::floor((pen + 32) / 64.0));
+                        auto edge = YAxisDown ? n.y - glyph.y_max : n.y + glyph.y_min; // top resp. bottom
+                        write(instances[n.first + i], pen_x + glyph.x_min, edge, 
+                            glyph.x_max - glyph.x_min, glyph.y_max - glyph.y_min, glyph.pixel_base, 0);
+                        pen += glyph.adv_x;
+                    }
+                }
+                else {
+                    write(instances[n.first], n.x, n.y, n.w, n.h, n.offset_x, n.offset_y);
+                }
+
+                dirty_ranges.emplace_back(n.first, n.count);
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::bounds(const node &n) const -> std::array<int, 4>
+            {
+                int x0 = std::numeric_limits<int>::max(), y0 = x0;
+                int x1 = std::numeric_limits<int>::min(), y1 = x1;
+                for (auto i = n.first; i < n.first + n.count; i++) {
+                    const auto &rec = instances[i];
+                    if (rec.w <= 0 || rec.h <= 0) continue; // hidden, or empty glyph
+                    x0 = std::min(x0, rec.x), y0 = std::min(y0, rec.y);
+                    x1 = std::max(x1, rec.x + rec.w), y1 = std::max(y1, rec.y + rec.h);
+                }
+
+                if (x1 <= x0) return {{ 0, 0, 0, 0 }};
+
+                return {{ x0, y0, x1 - x0, y1 - y0 }};
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::state_of(const node &n) const -> std::pair<int, GLuint>
+            {
+                auto mode = n.kind == node_kind::rect ? 7 : n.kind == node_kind::image ? 8 : 9;
+                auto texture = n.kind == node_kind::image ? n.image :
+                    n.kind == node_kind::text ? rend.resources->managed_fonts[n.font - 1].textures[n.variant] : 0;
+
+                return { mode, texture };
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::grid_cell(int coord) -> int
+            {
+                // Rounding towards minus infinity
+                return coord >= 0 ? coord / grid_cell_size : - ((- coord - 1) / grid_cell_size) - 1;
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::grid_key(int col, int row) -> std::uint64_t
+            {
+                return (std::uint64_t(static_cast<std::uint32_t>(col)) << 32) | static_cast<std::uint32_t>(row);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::enter_grid(node_id id, const std::array<int, 4> &r)
+            {
+                auto for_cells = [this](const std::array<int, 4> &rect, auto f) {
+                    if (rect[2] <= 0 || rect[3] <= 0) return;
+                    for (auto row = grid_cell(rect[1]); row <= grid_cell(rect[1] + rect[3] - 1); row++) {
+                        for (auto col = grid_cell(rect[0]); col <= grid_cell(rect[0] + rect[2] - 1); col++) f(grid[grid_key(col, row)]);
+                    }
+                };
+
+                auto &n = nodes[id - 1];
+                for_cells(n.placed, [id](std::vector<node_id> &cell_nodes) {
+                    auto it = std::find(std::begin(cell_nodes), std::end(cell_nodes), id);
+                    *it = cell_nodes.back();
+                    cell_nodes.pop_back();
+                });
+                n.placed = r;
+                for_cells(n.placed, [id](std::vector<node_id> &cell_nodes) { cell_nodes.push_back(id); });
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::batch_window(node_id id) const -> std::pair<int, int>
+            {
+                // A node must be drawn after the earlier nodes it overlaps and before the later ones
+                int first = 0, last = std::numeric_limits<int>::max();
+
+                const auto &r = nodes[id - 1].placed;
+                if (r[2] <= 0 || r[3] <= 0) return { first, last };
+
+                for (auto row = grid_cell(r[1]); row <= grid_cell(r[1] + r[3] - 1); row++) {
+                    for (auto col = grid_cell(r[0]); col <= grid_cell(r[0] + r[2] - 1); col++) {
+                        auto it = grid.find(grid_key(col, row));
+                        if (it == std::end(grid)) continue;
+                        for (auto other : it->second) {
+                            const auto &m = nodes[other - 1];
+                            if (other == id || m.batch < 0) continue;
+                            const auto &o = m.placed;
+                            if (!(o[0] < r[0] + r[2] && r[0] < o[0] + o[2] && o[1] < r[1] + r[3] && r[1] < o[1] + o[3])) continue;
+                            if (other < id) first = std::max(first, m.batch);
+                            else last = std::min(last, m.batch);
+                        }
+                    }
+                }
+
+                return { first, last };
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::retained_scene::place(node_id id) -> bool
+            {
+                auto &n = nodes[id - 1];
+                assert(n.batch < 0);
+
+                // Same placement rule as sorted submission (see submit_recorded()): the first batch
+                // with the same state the node may join, or a new one at the end
+                auto window = batch_window(id);
+                auto state = state_of(n);
+                auto b = static_cast<size_t>(window.first);
+                while (b < batches.size() && static_cast<int>(b) <= window.second && 
+                    !(batches[b].render_mode == state.first && batches[b].texture == state.second)) b++;
+                if (static_cast<int>(b) > window.second) return false;
+                if (b == batches.size()) batches.push_back({ state.first, state.second, {}, {}, 0, 0, true });
+
+                auto &list = batches[b].nodes;
+                list.insert(std::lower_bound(std::begin(list), std::end(list), id), id);
+                batches[b].dirty = true;
+                n.batch = static_cast<int>(b);
+
+                return true;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::unplace(node_id id)
+            {
+                auto &n = nodes[id - 1];
+                if (n.batch < 0) return;
+
+                auto &bat = batches[n.batch];
+                bat.nodes.erase(std::lower_bound(std::begin(bat.nodes), std::end(bat.nodes), id));
+                bat.dirty = true;
+                n.batch = -1;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::update_placement(node_id id)
+            {
+                auto &n = nodes[id - 1];
+                if (n.kind == node_kind::removed) return;
+
+                auto r = bounds(n);
+                auto moved = r != n.placed;
+                if (moved) enter_grid(id, r);
+
+                if (n.count == 0) return unplace(id);
+                if (rebuild_batches) return;
+
+                // Keep the batch as long as it has the right state and respects the node's overlaps
+                if (n.batch >= 0) {
+                    const auto &bat = batches[n.batch];
+                    auto state = state_of(n);
+                    if (bat.render_mode == state.first && bat.texture == state.second) {
+                        if (!moved) return;
+                        auto window = batch_window(id);
+                        if (window.first <= n.batch && n.batch <= window.second) return;
+                    }
+                    unplace(id);
+                }
+
+                if (!place(id)) rebuild_batches = true;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::form_batches()
+            {
+                batches.clear();
+                for (auto &n : nodes) n.batch = -1;
+
+                // Placing the nodes in drawing order, later nodes cannot be in the way
+                for (node_id id = 1; id <= nodes.size(); id++) {
+                    const auto &n = nodes[id - 1];
+                    if (n.kind == node_kind::removed || n.count == 0) continue;
+                    auto placed = place(id);
+                    assert(placed);
+                    (void) placed;
+                }
+
+                command_capacity = 0; // lay out the command buffer anew
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::upload_commands()
+            {
+                auto relayout = command_capacity == 0;
+
+                // One command per run of consecutive instance records, in drawing order
+                for (auto &bat : batches) {
+                    if (!bat.dirty) continue;
+                    bat.commands.clear();
+                    for (auto id : bat.nodes) {
+                        const auto &n = nodes[id - 1];
+                        if (n.count == 0) continue;
+                        if (!bat.commands.empty() && bat.commands.back().base_instance + bat.commands.back().instance_count == n.first) {
+                            bat.commands.back().instance_count += static_cast<GLuint>(n.count);
+                        }
+                        else {
+                            bat.commands.push_back({ 4, static_cast<GLuint>(n.count), 0, 0, static_cast<GLuint>(n.first) });
+                        }
+                    }
+                    if (bat.commands.size() > bat.slot_count) relayout = true;
+                }
+
+                if (relayout) {
+                    // Leave each batch room to grow, so that later changes can be patched in place
+                    size_t total = 0;
+                    for (auto &bat : batches) {
+                        bat.first_slot = total, bat.slot_count = bat.commands.size() + bat.commands.size() / 2 + 2;
+                        total += bat.slot_count;
+                    }
+                    std::vector<draw_command> slots(total, draw_command{ 0, 0, 0, 0, 0 });
+                    for (auto &bat : batches) {
+                        std::copy(std::begin(bat.commands), std::end(bat.commands), std::begin(slots) + bat.first_slot);
+                        bat.dirty = false;
+                    }
+                    GLCALL(BufferData, GL_DRAW_INDIRECT_BUFFER, total * sizeof(draw_command), slots.empty() ? nullptr : &slots[0], GL_DYNAMIC_DRAW);
+                    stats.bytes_uploaded += total * sizeof(draw_command);
+                    rend.resources->memory.allocate(buffer_memory(command_buffer), memory_category::streaming, 
+                        total * sizeof(draw_command), "scene draw commands");
+                    command_capacity = total;
+                }
+                else {
+                    for (auto &bat : batches) {
+                        if (!bat.dirty) continue;
+                        if (!bat.commands.empty()) {
+                            GLCALL(BufferSubData, GL_DRAW_INDIRECT_BUFFER, bat.first_slot * sizeof(draw_command), 
+                                bat.commands.size() * sizeof(draw_command), &bat.commands[0]);
+                            stats.bytes_uploaded += bat.commands.size() * sizeof(draw_command);
+                        }
+                        bat.dirty = false;
+                    }
+                }
+
+                stats.batches = 0, stats.draw_commands = 0;
+                for (const auto &bat : batches) {
+                    if (!bat.commands.empty()) stats.batches++;
+                    stats.draw_commands += bat.commands.size();
+                }
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::update()
+            {
+                stats.bytes_uploaded = 0;
+
+                // Upload the changed instance records
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, instance_buffer);
+                if (instances.size() > instance_capacity) {
+                    instance_capacity = std::max<size_t>(std::max<size_t>(instances.size(), 2 * instance_capacity), 256);
+                    GLCALL(BufferData, GL_ARRAY_BUFFER, instance_capacity * sizeof(instance_record), nullptr, GL_DYNAMIC_DRAW);
+                    GLCALL(BufferSubData, GL_ARRAY_BUFFER, 0, instances.size() * sizeof(instance_record), &instances[0]);
+                    stats.bytes_uploaded += instances.size() * sizeof(instance_record);
+                    rend.resources->memory.allocate(buffer_memory(instance_buffer), memory_category::streaming, 
+                        instance_capacity * sizeof(instance_record), "scene instances");
+                }
+                else {
+                    std::sort(std::begin(dirty_ranges), std::end(dirty_ranges));
+                    for (auto i = 0U; i < dirty_ranges.size(); ) {
+                        auto first = dirty_ranges[i].first, end = first + dirty_ranges[i].second;
+                        for (i++; i < dirty_ranges.size() && dirty_ranges[i].first <= end; i++) {
+                            end = std::max(end, dirty_ranges[i].first + dirty_ranges[i].second);
+                        }
+                        GLCALL(BufferSubData, GL_ARRAY_BUFFER, first * sizeof(instance_record), 
+                            (end - first) * sizeof(instance_record), &instances[first]);
+                        stats.bytes_uploaded += (end - first) * sizeof(instance_record);
+                    }
+                }
+                dirty_ranges.clear();
+
+                // Re-place the nodes whose records changed; re-form all batches only if that fails, 
+                // or if many batches have been left empty
+                for (auto id : touched_nodes) update_placement(id);
+                touched_nodes.clear();
+                auto empty_batches = static_cast<size_t>(std::count_if(std::begin(batches), std::end(batches), 
+                    [](const batch &bat) { return bat.nodes.empty(); }));
+                if (rebuild_batches || (empty_batches > 8 && 2 * empty_batches > batches.size())) {
+                    form_batches();
+                    rebuild_batches = false;
+                }
+
+                GLCALL(BindBuffer, GL_DRAW_INDIRECT_BUFFER, command_buffer);
+                upload_commands();
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::retained_scene::draw()
+            {
+                using gpc::gl::setUniform;
+
+                // Keep the order relative to what has been drawn through the renderer
+                if (rend.recording) rend.submit_recorded();
+
+                update();
+
+                if (stats.draw_commands > 0) {
+
+                    // Attribute 0 (vertex position) supplies the corners of the unit quad
+                    GLCALL(EnableClientState, GL_VERTEX_ARRAY);
+                    GLCALL(BindBuffer, GL_ARRAY_BUFFER, rend.quad_corner_buffer);
+                    GLCALL(VertexPointer, 2, GL_INT, 0, static_cast<GLvoid*>(0));
+
+                    // Attributes 4 - 7 come from the instance records
+                    const GLsizei stride = sizeof(instance_record);
+                    GLCALL(BindBuffer, GL_ARRAY_BUFFER, instance_buffer);
+                    GLCALL(VertexAttribIPointer, 4, 4, GL_INT, stride, reinterpret_cast<GLvoid*>(offsetof(instance_record, x)));
+                    GLCALL(VertexAttribPointer, 5, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<GLvoid*>(offsetof(instance_record, color)));
+                    GLCALL(VertexAttribIPointer, 6, 2, GL_INT, stride, reinterpret_cast<GLvoid*>(offsetof(instance_record, offset_x)));
+                    GLCALL(VertexAttribIPointer, 7, 4, GL_INT, stride, reinterpret_cast<GLvoid*>(offsetof(instance_record, clip_x)));
+                    for (GLuint i = 4; i <= 7; i++) {
+                        GLCALL(EnableVertexAttribArray, i);
+                        GLCALL(VertexAttribDivisor, i, 1);
+                    }
+                    GLCALL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+
+                    for (const auto &bat : batches) {
+                        if (bat.commands.empty()) continue;
+                        rend.use_render_mode(bat.render_mode); // 7 = rectangles, 8 = images, 9 = glyphs
+                        if (bat.render_mode == 8) rend.bind_image_texture(bat.texture);
+                        if (bat.render_mode == 9) {
+                            rend.bind_font_texture(bat.texture);
+                            setUniform("font_pixels", 7, 1); // texture unit 1
+                        }
+                        GLCALL(MultiDrawElementsIndirect, GL_TRIANGLE_STRIP, GL_UNSIGNED_SHORT, 
+                            reinterpret_cast<GLvoid*>(bat.first_slot * sizeof(draw_command)), static_cast<GLsizei>(bat.commands.size()), 0);
+                        rend.stats.count_draw_call();
+                    }
+
+                    for (GLuint i = 4; i <= 7; i++) {
+                        GLCALL(VertexAttribDivisor, i, 0);
+                        GLCALL(DisableVertexAttribArray, i);
+                    }
+                    GLCALL(DisableClientState, GL_VERTEX_ARRAY);
+                    GLCALL(BindBuffer, GL_ELEMENT_ARRAY_BUFFER, 0);
                 }
 
-                GL(BindTexture, GL_TEXTURE_BUFFER, 0);
-                GL(DisableClientState, GL_VERTEX_ARRAY);
-                GL(BindBuffer, GL_ARRAY_BUFFER, 0);
+                GLCALL(BindBuffer, GL_DRAW_INDIRECT_BUFFER, 0);
+                GLCALL(BindBuffer, GL_ARRAY_BUFFER, 0);
             }
 
             // managed_font private class -------------------------------------
 
-            template <bool YAxisDown>
-            inline void renderer<YAxisDown>::managed_font::create_quads()
+            template <bool YAxisDown, typename Config>
+            renderer<YAxisDown, Config>::managed_font::managed_font(const rasterized_font &font_, int subpixel_steps_, bool codepoint_table) :
+                variant_count{ font_.variants.size() },
+                glyph_count{ font_.variants.empty() ? 0 : font_.variants[0].glyphs.size() },
+                glyphs(make_glyph_table(font_)),
+                subpixel_steps{ subpixel_steps_ }
+            {
+                if (codepoint_table) {
+                    assert(subpixel_steps <= 1);
+                    codepoints = make_codepoint_table(font_, fallback_glyph);
+                    return;
+                }
+
+                // The pixels get uploaded; only the subpixel cache has to go back to them
+                auto copy = std::make_shared<rasterized_font>(font_);
+                if (subpixel_steps <= 1) {
+                    for (auto &variant : copy->variants) {
+                        variant.pixels.clear();
+                        variant.pixels.shrink_to_fit();
+                    }
+                }
+                source = std::move(copy);
+            }
+
+            template <bool YAxisDown, typename Config>
+            renderer<YAxisDown, Config>::managed_font::managed_font(const mapped_gpu_font &file) :
+                codepoints(file.codepoints(), file.codepoints() + file.header().codepoint_count),
+                fallback_glyph{ file.header().fallback_glyph },
+                variant_count{ file.header().variant_count },
+                glyph_count{ file.header().glyph_count },
+                glyphs(file.glyphs(), file.glyphs() + variant_count * glyph_count),
+                subpixel_steps{ 1 }
+            {
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::managed_font::find_glyph(char32_t codepoint) const -> int
+            {
+                if (source) return source->find_glyph(codepoint);
+
+                auto it = std::lower_bound(std::begin(codepoints), std::end(codepoints), codepoint, 
+                    [](const gpu_font_codepoint &entry, char32_t cp) { return entry.codepoint < cp; });
+                if (it != std::end(codepoints) && it->codepoint == codepoint) return it->glyph;
+
+                return fallback_glyph >= 0 ? fallback_glyph : 0;
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::managed_font::store_pixels(const std::uint8_t *pixels, size_t size)
+            {
+                buffer_textures.push_back(0);
+                GLCALL(GenBuffers, 1, &buffer_textures.back());
+
+                textures.push_back(0);
+                GLCALL(GenTextures, 1, &textures.back());
+
+                GLCALL(BindBuffer, GL_TEXTURE_BUFFER, buffer_textures.back());
+
+                // Load the pixels into a texture buffer object
+                // TODO: really no flags ?
+                GLCALL(BufferStorage, GL_TEXTURE_BUFFER, size, pixels, (BufferStorageMask)0);
+                pixel_bytes += size;
+                buffer_sizes.push_back(size);
+
+                // Bind the texture buffer object as a.. texture
+                GLCALL(BindTexture, GL_TEXTURE_BUFFER, textures.back());
+                GLCALL(TexBuffer, GL_TEXTURE_BUFFER, GL_R8, buffer_textures.back());
+
+                GLCALL(BindBuffer, GL_TEXTURE_BUFFER, 0);
+                GLCALL(BindTexture, GL_TEXTURE_BUFFER, 0);
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::managed_font::account_memory(memory_ledger &memory, font_handle handle) const
+            {
+                auto name = "font " + std::to_string(handle);
+
+                for (auto i = 0U; i < buffer_textures.size(); i++) {
+                    memory.allocate(buffer_memory(buffer_textures[i]), memory_category::fonts, buffer_sizes[i],
+                        name + " variant " + std::to_string(i));
+                }
+                if (sdf_buffer != 0) memory.allocate(buffer_memory(sdf_buffer), memory_category::fonts, sdf_size, name + " distance field");
+                if (cache_buffer != 0) memory.allocate(buffer_memory(cache_buffer), memory_category::fonts, cache_capacity, name + " subpixel cache");
+            }
+
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::managed_font::generate_distance_field(const rasterized_font &font, int spread)
             {
-                struct Vertex { GLint x, y; };
+                sdf_spread = spread;
+
+                // Lay out the padded glyphs one after the other, so that each can be generated independently
+                size_t total = 0;
+                for (const auto &glyph : glyphs) {
+                    int w = glyph.x_max - glyph.x_min, h = glyph.y_max - glyph.y_min;
+                    cached_glyph sg{ static_cast<GLint>(total), glyph.x_min, glyph.x_max, glyph.y_min, glyph.y_max };
+                    if (w > 0 && h > 0) {
+                        sg.x_min -= spread, sg.x_max += spread, sg.y_min -= spread, sg.y_max += spread;
+                        total += (w + 2 * spread) * (h + 2 * spread);
+                    }
+                    sdf_glyphs.push_back(sg);
+                }
+                sdf_pixels.resize(total);
+
+                auto generate = [this, &font, spread](size_t index, const cached_glyph &sg) {
+
+                    const auto &glyph = glyphs[index];
+                    int w = glyph.x_max - glyph.x_min, h = glyph.y_max - glyph.y_min;
+                    if (w <= 0 || h <= 0) return;
+
+                    const auto *src = &font.variants[index / glyph_count].pixels[glyph.pixel_base];
+                    auto coverage = [&](int col, int row) {
+                        return col >= 0 && col < w && row >= 0 && row < h ? src[row * w + col] / 255.0f : 0.0f;
+                    };
+
+                    // Brute-force search, within the spread, for the nearest edge. The antialiased coverage
+                    // places the edge to a fraction of a pixel: a pixel with coverage c has its center about
+                    // (c - 0.5) pixels inside the outline (negative: outside). Hence the edge between a pixel
+                    // and one of opposite state is at their distance minus the latter's offset from it.
+                    auto *dst = &sdf_pixels[sg.pixel_base];
+                    int w_out = w + 2 * spread, h_out = h + 2 * spread;
+                    for (auto row = 0; row < h_out; row++) {
+                        for (auto col = 0; col < w_out; col++) {
+                            int sc = col - spread, sr = row - spread;
+                            auto c = coverage(sc, sr);
+                            bool in = c >= 0.5f;
+                            // A partially covered pixel holds its own edge estimate
+                            auto dist = c > 0 && c < 1 ? std::abs(c - 0.5f) : static_cast<float>(spread);
+                            for (auto dy = -spread; dy <= spread; dy++) {
+                                for (auto dx = -spread; dx <= spread; dx++) {
+                                    auto c2 = coverage(sc + dx, sr + dy);
+                                    if ((c2 >= 0.5f) == in) continue;
+                                    auto d = std::sqrt(static_cast<float>(dx * dx + dy * dy)) - std::abs(c2 - 0.5f);
+                                    dist = std::min(dist, d);
+                                }
+                            }
+                            auto value = 0.5f + (in ? dist : -dist) / (2 * spread);
+                            *dst++ = static_cast<std::uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255 + 0.5f);
+                        }
+                    }
+                };
+
+                // Distribute the glyphs over as many threads as there are cores
+                std::atomic<size_t> next{ 0 };
+                auto worker = [&]() {
+                    for (size_t i; (i = next++) < sdf_glyphs.size(); ) generate(i, sdf_glyphs[i]);
+                };
+
+                auto thread_count = std::max(1U, std::thread::hardware_concurrency());
+                std::vector<std::thread> threads;
+                for (auto i = 1U; i < thread_count; i++) threads.emplace_back(worker);
+                worker();
+                for (auto &thread : threads) thread.join();
+            }
 
-                GL(GenBuffers, 1, &vertex_buffer);
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::managed_font::store_distance_field()
+            {
+                sdf_size = sdf_pixels.size();
 
-                // Compute total number of glyphs in font
-                auto glyph_count = 0U;
-                for (const auto &variant : variants) glyph_count += variant.glyphs.size();
+                GLCALL(GenBuffers, 1, &sdf_buffer);
+                GLCALL(BindBuffer, GL_TEXTURE_BUFFER, sdf_buffer);
+                GLCALL(BufferStorage, GL_TEXTURE_BUFFER, std::max<size_t>(sdf_size, 1), sdf_size > 0 ? &sdf_pixels[0] : nullptr, (BufferStorageMask)0);
 
-                // Allocate a buffer big enough to hold each glyph as a quad or triangle strip
-                std::vector<Vertex> vertices;
-                vertices.reserve(4 * glyph_count);
+                GLCALL(GenTextures, 1, &sdf_texture);
+                GLCALL(BindTexture, GL_TEXTURE_BUFFER, sdf_texture);
+                GLCALL(TexBuffer, GL_TEXTURE_BUFFER, GL_R8, sdf_buffer);
 
-                // Create a quad of 2D vertices (relative to insertion point) for each glyph
-                for (const auto &variant : variants) {
+                GLCALL(BindBuffer, GL_TEXTURE_BUFFER, 0);
+                GLCALL(BindTexture, GL_TEXTURE_BUFFER, 0);
 
-                    // TODO: store and use the base index for each font variant
+                // The field lives on the GPU from now on
+                sdf_pixels.clear();
+                sdf_pixels.shrink_to_fit();
+            }
 
-                    for (const auto &glyph : variant.glyphs) {
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::managed_font::variant_offset(int var_index) const -> size_t
+            {
+                return std::accumulate(std::begin(buffer_sizes), std::begin(buffer_sizes) + var_index, size_t{ 0 });
+            }
 
-#ifndef NOT_DEFINED
-                        if (YAxisDown) {
-                            /* top left     */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_min, -glyph.cbox.bounds.y_max });
-                            /* bottom left  */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_min, -glyph.cbox.bounds.y_min });
-                            /* bottom right */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_max, -glyph.cbox.bounds.y_min });
-                            /* top right    */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_max, -glyph.cbox.bounds.y_max });
-                        }                                                                
-                        else {                                                           
-                            /* bottom left  */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_min,  glyph.cbox.bounds.y_min });
-                            /* bottom right */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_max,  glyph.cbox.bounds.y_min });
-                            /* top right    */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_max,  glyph.cbox.bounds.y_max });
-                            /* top left     */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_min,  glyph.cbox.bounds.y_max });
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::managed_font::subpixel_glyph(int var_index, int glyph_index, int step) -> cached_glyph
+            {
+                assert(source && subpixel_steps > 1); // subpixel variants are generated from the rasterized glyphs
+                assert(step > 0 && step < subpixel_steps); // step 0 is the glyph as registered
+
+                if (cache_slots.empty()) cache_slots.resize(variant_count * glyph_count * (subpixel_steps - 1), -1);
+
+                auto &slot = cache_slots[(var_index * glyph_count + glyph_index) * (subpixel_steps - 1) + step - 1];
+                if (slot < 0) {
+
+                    const auto &glyph = this->glyph(var_index, glyph_index);
+                    int w = glyph.x_max - glyph.x_min, h = glyph.y_max - glyph.y_min;
+
+                    cached_glyph cg;
+                    cg.pixel_base = static_cast<GLint>(cache_size + pending_pixels.size());
+                    cg.x_min = glyph.x_min, cg.x_max = glyph.x_max;
+                    cg.y_min = glyph.y_min, cg.y_max = glyph.y_max;
+
+                    if (w > 0 && h > 0) {
+                        // Shift the glyph right by step/subpixel_steps of a pixel, widening it by one column
+                        auto f = static_cast<float>(step) / subpixel_steps;
+                        auto w_out = w + 1;
+                        const auto *src = &source->variants[var_index].pixels[glyph.pixel_base];
+                        for (auto row = 0; row < h; row++) {
+                            for (auto col = 0; col < w_out; col++) {
+                                float v = 0;
+                                if (col < w) v += (1 - f) * src[row * w + col];
+                                if (col > 0) v += f * src[row * w + col - 1];
+                                pending_pixels.push_back(static_cast<std::uint8_t>(v + 0.5f));
+                            }
                         }
-#else
-                        /* bottom left  */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_min,  glyph.cbox.bounds.y_min });
-                        /* bottom right */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_max,  glyph.cbox.bounds.y_min });
-                        /* top right    */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_max,  glyph.cbox.bounds.y_max });
-                        /* top left     */ vertices.emplace_back<Vertex>({ glyph.cbox.bounds.x_min,  glyph.cbox.bounds.y_max });
-#endif
+                        cg.x_max = glyph.x_min + w_out;
                     }
+
+                    slot = static_cast<GLint>(cached_glyphs.size());
+                    cached_glyphs.push_back(cg);
                 }
 
-                // Upload the vertex array
-                GL(BindBuffer, GL_ARRAY_BUFFER, vertex_buffer);
-                GL(BufferData, GL_ARRAY_BUFFER, vertices.size()*sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-                GL(BindBuffer, GL_ARRAY_BUFFER, 0); // just in case
+                return cached_glyphs[slot];
             }
 
-            template <bool YAxisDown>
-            void renderer<YAxisDown>::managed_font::store_pixels()
+            template <bool YAxisDown, typename Config>
+            void renderer<YAxisDown, Config>::managed_font::flush_subpixel_cache()
             {
-                buffer_textures.resize(variants.size());
-                GL(GenBuffers, buffer_textures.size(), &buffer_textures[0]);
+                if (pending_pixels.empty() && cache_buffer != 0) return;
 
-                textures.resize(variants.size());
-                GL(GenTextures, textures.size(), &textures[0]);
+                auto needed = cache_size + pending_pixels.size();
 
-                for (auto i_var = 0U; i_var < variants.size(); i_var++) {
+                if (needed > cache_capacity) {
 
-                    GL(BindBuffer, GL_TEXTURE_BUFFER, buffer_textures[i_var]);
+                    // Grow geometrically, carrying over the glyphs that are already on the GPU
+                    auto capacity = std::max<size_t>(std::max<size_t>(needed, 2 * cache_capacity), 16 * 1024);
 
-                    auto &variant = variants[i_var];
+                    GLuint buffer;
+                    GLCALL(GenBuffers, 1, &buffer);
+                    GLCALL(BindBuffer, GL_COPY_WRITE_BUFFER, buffer);
+                    GLCALL(BufferData, GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+                    if (cache_buffer != 0) {
+                        GLCALL(BindBuffer, GL_COPY_READ_BUFFER, cache_buffer);
+                        GLCALL(CopyBufferSubData, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, cache_size);
+                        GLCALL(BindBuffer, GL_COPY_READ_BUFFER, 0);
+                        GLCALL(DeleteBuffers, 1, &cache_buffer);
+                    }
+                    else {
+                        // New cache: seed it with the variants' pixels (GPU-side copy)
+                        size_t offset = 0;
+                        for (auto i = 0U; i < buffer_textures.size(); i++) {
+                            GLCALL(BindBuffer, GL_COPY_READ_BUFFER, buffer_textures[i]);
+                            GLCALL(CopyBufferSubData, GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, buffer_sizes[i]);
+                            offset += buffer_sizes[i];
+                        }
+                        GLCALL(BindBuffer, GL_COPY_READ_BUFFER, 0);
+                    }
+                    GLCALL(BindBuffer, GL_COPY_WRITE_BUFFER, 0);
+                    cache_buffer = buffer, cache_capacity = capacity;
 
-                    // Load the pixels into a texture buffer object
-                    // TODO: really no flags ?
-                    GL(BufferStorage, GL_TEXTURE_BUFFER, variant.pixels.size(), &variant.pixels[0], (BufferStorageMask)0);
+                    if (cache_texture == 0) GLCALL(GenTextures, 1, &cache_texture);
+                    GLCALL(BindTexture, GL_TEXTURE_BUFFER, cache_texture);
+                    GLCALL(TexBuffer, GL_TEXTURE_BUFFER, GL_R8, cache_buffer);
+                    GLCALL(BindTexture, GL_TEXTURE_BUFFER, 0);
+                }
 
-                    // Bind the texture buffer object as a.. texture
-                    GL(BindTexture, GL_TEXTURE_BUFFER, textures[i_var]);
-                    GL(TexBuffer, GL_TEXTURE_BUFFER, GL_R8, buffer_textures[i_var]);
+                if (!pending_pixels.empty()) {
+                    GLCALL(BindBuffer, GL_TEXTURE_BUFFER, cache_buffer);
+                    GLCALL(BufferSubData, GL_TEXTURE_BUFFER, cache_size, pending_pixels.size(), &pending_pixels[0]);
+                    GLCALL(BindBuffer, GL_TEXTURE_BUFFER, 0);
                 }
 
-                GL(BindBuffer, GL_TEXTURE_BUFFER, 0);
-                GL(BindTexture, GL_TEXTURE_BUFFER, 0);
+                cache_size = needed;
+                pending_pixels.clear();
+            }
+
+            template <bool YAxisDown, typename Config>
+            auto renderer<YAxisDown, Config>::managed_font::discard_subpixel_cache() -> size_t
+            {
+                auto freed = cache_capacity;
+
+                if (cache_buffer != 0) GLCALL(DeleteBuffers, 1, &cache_buffer); // the texture is re-attached when the cache grows again
+                cache_buffer = 0, cache_size = pixel_bytes, cache_capacity = 0; // the seed is copied again on re-creation
+                std::fill(std::begin(cache_slots), std::end(cache_slots), -1);
+                cached_glyphs.clear();
+                pending_pixels.clear();
+
+                return freed;
             }
 
         } // ns gl
     } // ns gui
-} // ns gpc
\ No newline at end of file
+} // ns gpc
+
+#undef GLCALL
\ No newline at end of file
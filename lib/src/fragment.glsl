@@ -10,14 +10,42 @@ layout(location =  5) uniform int               render_mode;
 layout(location =  6) uniform ivec2             offset;             // when rendering images: top-left corner inside image
 layout(location = 10) uniform mat2              texcoord_matrix = mat2(1.0);
 layout(location =  7) uniform samplerBuffer     font_pixels; 
-layout(location =  8) uniform int               glyph_base;
-layout(location =  9) uniform ivec4             glyph_cbox;
+layout(location = 12) uniform vec4              shape_rect;         // shapes: x, y, w, h
+layout(location = 13) uniform vec4              shape_params;       // shapes: corner radius, border width (0 = fill), blur
+layout(location = 14) uniform int               paint_mode;         // shapes: 0 = solid, 1 = linear gradient, 2 = radial gradient
+layout(location = 15) uniform vec4              gradient;           // linear: x0, y0, x1, y1; radial: cx, cy, r
+layout(location = 16) uniform vec4              color2;             // gradients: end color
 
 in  vec2 tp;
+flat in int   glyph_base;                                           // glyph rendering: offset of pixels in font_pixels
+flat in ivec4 glyph_cbox;                                           // glyph rendering: x_min, x_max, y_min, y_max
+flat in vec4  fill_color;                                           // bulk rectangles: color
+flat in ivec2 image_offset;                                         // bulk images: top-left corner inside image
+flat in ivec4 clip_rect;                                            // bulk and retained primitives: x, y, w, h (w = 0: none)
+in  vec2 pixel_pos;                                                 // bulk and retained primitives
 out vec4 fragment_color;
 
+// Distance field texel of the current glyph, clamped to the glyph's box
+float distance_texel(int col, int row, int w, int h)
+{
+    return texelFetch(font_pixels, glyph_base + clamp(row, 0, h - 1) * w + clamp(col, 0, w - 1)).r;
+}
+
+// Signed distance from a rounded rectangle (negative inside)
+float rounded_rect_distance(vec2 p, vec4 rect, float radius)
+{
+    vec2 half_size = rect.zw / 2;
+    radius = min(radius, min(half_size.x, half_size.y));
+    vec2 q = abs(p - (rect.xy + half_size)) - half_size + radius;
+    return min(max(q.x, q.y), 0.0) + length(max(q, 0.0)) - radius;
+}
+
 void main() {
 
+    // Per-instance clipping (retained scene)
+    if (render_mode >= 7 && clip_rect.z > 0 && (any(lessThan(pixel_pos, vec2(clip_rect.xy))) || 
+        any(greaterThanEqual(pixel_pos, vec2(clip_rect.xy + clip_rect.zw))))) discard;
+
     // Apply single color
     if (render_mode == 1) {
 
@@ -29,6 +57,32 @@ void main() {
         ivec2 tex_size = textureSize(sampler);
         fragment_color = texelFetch(sampler, (ivec2(tp) + offset) % tex_size);
     }
+    // Bulk rectangles
+    else if (render_mode == 7) {
+
+        fragment_color = fill_color;
+    }
+    // Bulk image pasting
+    else if (render_mode == 8) {
+
+        ivec2 tex_size = textureSize(sampler);
+        fragment_color = texelFetch(sampler, (ivec2(tp) + image_offset) % tex_size);
+    }
+    // Retained scene glyphs: the instance rectangle is the glyph box, rows are stored top to bottom
+    else if (render_mode == 9) {
+
+        int w = glyph_cbox[1], h = glyph_cbox[3];
+        int col = int(tp.x);
+        #ifdef Y_AXIS_DOWN
+        int row = int(tp.y);
+        #else
+        int row = h - 1 - int(tp.y);
+        #endif
+
+        float alpha = texelFetch(font_pixels, glyph_base + row * w + col).r;
+
+        fragment_color = vec4(fill_color.rgb, alpha * fill_color.a);
+    }
     // Mono image modulating
     // TODO: renumber rendering modes
     else if (render_mode == 4) {
@@ -53,4 +107,58 @@ void main() {
 
         fragment_color = vec4(color.rgb, alpha * color.a);
     }
+    // Distance field glyph rendering
+    else if (render_mode == 5) {
+
+        int x_min = glyph_cbox[0], x_max = glyph_cbox[1], y_min = glyph_cbox[2], y_max = glyph_cbox[3];
+        int w = x_max - x_min, h = y_max - y_min;
+
+        #ifdef Y_AXIS_DOWN
+        vec2 gp = vec2(tp.x, - tp.y);
+        #else
+        vec2 gp = tp;
+        #endif
+
+        // Bilinear interpolation between texel centers (top row first)
+        vec2 st = vec2(gp.x - x_min, y_max - gp.y) - 0.5;
+        ivec2 i0 = ivec2(floor(st));
+        vec2 f = st - vec2(i0);
+        float d = mix(
+            mix(distance_texel(i0.x, i0.y    , w, h), distance_texel(i0.x + 1, i0.y    , w, h), f.x),
+            mix(distance_texel(i0.x, i0.y + 1, w, h), distance_texel(i0.x + 1, i0.y + 1, w, h), f.x), f.y);
+
+        // Anti-alias over about one screen pixel, whatever the scale
+        float aa = max(0.7 * fwidth(d), 1.0 / 255.0);
+        float alpha = smoothstep(0.5 - aa, 0.5 + aa, d);
+
+        fragment_color = vec4(color.rgb, alpha * color.a);
+    }
+    // Shapes (rounded rectangles, borders, gradients, shadows)
+    else if (render_mode == 6) {
+
+        float radius = shape_params[0], border = shape_params[1], blur = shape_params[2];
+        float d = rounded_rect_distance(tp, shape_rect, radius);
+
+        float coverage;
+        if (blur > 0) {
+            coverage = 1 - smoothstep(- blur, blur, d);
+        }
+        else {
+            coverage = clamp(0.5 - d, 0.0, 1.0);
+            if (border > 0) coverage *= clamp(0.5 + d + border, 0.0, 1.0);
+        }
+
+        vec4 paint = color;
+        if (paint_mode == 1) {
+            // Identical endpoints degenerate to color
+            vec2 axis = gradient.zw - gradient.xy;
+            paint = mix(color, color2, clamp(dot(tp - gradient.xy, axis) / max(dot(axis, axis), 1e-6), 0.0, 1.0));
+        }
+        else if (paint_mode == 2) {
+            // A zero radius degenerates to color2 everywhere but the center
+            paint = mix(color, color2, clamp(length(tp - gradient.xy) / max(gradient.z, 1e-6), 0.0, 1.0));
+        }
+
+        fragment_color = vec4(paint.rgb, paint.a * coverage);
+    }
 }
\ No newline at end of file
@@ -6,28 +6,67 @@ layout(location =  1) uniform int           viewport_h;
 layout(location =  4) uniform ivec2         position;
 layout(location = 10) uniform mat2          texcoord_matrix = mat2(1.0);
 layout(location =  5) uniform int           render_mode;
-layout(location =  9) uniform ivec4         glyph_cbox;
+layout(location = 11) uniform float         glyph_scale = 1.0;  // distance field glyphs only
 
-in  vec2 vp; // vertex position
+layout(location = 0) in vec2 vp; // vertex position (quad corner as 0/1 pairs when drawing instances)
 out vec2 tp; // texel position
 
+// Per-instance attributes of text glyphs
+layout(location =  1) in ivec2              glyph_position;     // pen position (in 1/64 pixels for distance field glyphs)
+layout(location =  2) in int                glyph_pixel_base;
+layout(location =  3) in ivec4              glyph_box;          // x_min, x_max, y_min, y_max
+
+flat out int   glyph_base;
+flat out ivec4 glyph_cbox;
+
+// Per-instance attributes of bulk-submitted rectangles (7) and images (8), and of retained scene glyphs (9)
+layout(location =  4) in ivec4              instance_rect;      // x, y, w, h
+layout(location =  5) in vec4               instance_color;
+layout(location =  6) in ivec2              instance_offset;    // top-left corner inside image; glyphs: pixel base
+layout(location =  7) in ivec4              instance_clip;      // x, y, w, h (w = 0: no clipping)
+
+flat out vec4  fill_color;
+flat out ivec2 image_offset;
+flat out ivec4 clip_rect;
+out vec2 pixel_pos;
+
 void main() {
 
-    // Rendering text glyphs ?
-    if (render_mode == 3)
+    // Rendering text glyphs, bitmap (3) or distance field (5), one instance per glyph ?
+    if (render_mode == 3 || render_mode == 5)
+    {
+        // Select the corner of the glyph's bounding box
+        vec2 gp = vec2(vp.x == 0 ? glyph_box[0] : glyph_box[1], vp.y == 0 ? glyph_box[2] : glyph_box[3]);
+        vec2 origin = render_mode == 5 ? vec2(glyph_position) / 64.0 : vec2(glyph_position);
+        float scale = render_mode == 5 ? glyph_scale : 1.0;
+        #ifdef Y_AXIS_DOWN
+        gp.y = - gp.y;
+        gl_Position = vec4(2 * (origin.x + scale * gp.x) / float(viewport_w) - 1, - (2 * (origin.y + scale * gp.y) / float(viewport_h) - 1), 0.0, 1.0);
+        #else
+        gl_Position = vec4(2 * (origin.x + scale * gp.x) / float(viewport_w) - 1,    2 * (origin.y + scale * gp.y) / float(viewport_h) - 1 , 0.0, 1.0);
+        #endif
+        tp = gp;
+        glyph_base = glyph_pixel_base;
+        glyph_cbox = glyph_box;
+    }
+    // Bulk-submitted or retained rectangles, images or glyphs, one instance per rectangle ?
+    else if (render_mode == 7 || render_mode == 8 || render_mode == 9)
     {
+        vec2 p = vec2(instance_rect.xy) + vp * vec2(instance_rect.zw);
         #ifdef Y_AXIS_DOWN
-        vec2 pixel_position = position + ivec2(vp.x, - vp.y);
-        gl_Position = vec4(2 * float(position.x + vp.x) / float(viewport_w) - 1, - (2 * float(position.y + vp.y) / float(viewport_h) - 1), 0.0, 1.0);
-        //tp = vec2(vp.x, - vp.y);
+        gl_Position = vec4(2 * p.x / float(viewport_w) - 1, - (2 * p.y / float(viewport_h) - 1), 0.0, 1.0);
         #else
-        ivec2 pixel_position = position + ivec2(vp);
-        gl_Position = vec4(2 * float(position.x + vp.x) / float(viewport_w) - 1,    2 * float(position.y + vp.y) / float(viewport_h) - 1 , 0.0, 1.0);
-        //tp = vp;
+        gl_Position = vec4(2 * p.x / float(viewport_w) - 1,    2 * p.y / float(viewport_h) - 1 , 0.0, 1.0);
         #endif
-        tp = vp;
+        tp = vp * vec2(instance_rect.zw);
+        fill_color = instance_color;
+        image_offset = instance_offset;
+        clip_rect = instance_clip;
+        pixel_pos = p;
+        glyph_base = instance_offset.x;
+        glyph_cbox = ivec4(0, instance_rect.z, 0, instance_rect.w);
     }
-    // Painting color or image ?
+    // Painting color, image or shape ?
     //if (render_mode == 1 || render_mode == 2 || render_mode == 4)
     else
     {
@@ -36,6 +75,7 @@ void main() {
         #else
         gl_Position = vec4(2 * vp.x / float(viewport_w) - 1,    2 * vp.y / float(viewport_h) - 1 , 0.0, 1.0);
         #endif
-        tp = texcoord_matrix * (vp.xy - vec2(position));
+        // Shapes are evaluated in pixel coordinates
+        tp = render_mode == 6 ? vp : texcoord_matrix * (vp.xy - vec2(position));
     }
 }
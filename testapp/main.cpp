@@ -2,6 +2,9 @@
 #include <cstdio>
 #include <iostream>
 #include <sstream>
+#include <cstring>
+#include <vector>
+#include <memory>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
 //#include <SDL2/SDL_opengl.h>
@@ -179,9 +182,120 @@ namespace {
         SDL_DestroyWindow(window);
     }
 
+    /*  Two renderers in hidden windows whose GL contexts share objects: the second renderer
+        draws with the resources registered by the first, including an image that the first 
+        renderer replaces after the second one has drawn (and bound) its predecessor.
+        Returns the number of failed checks.
+     */
+    template <typename Renderer>
+    int test_shared_contexts()
+    {
+        static const int size = 16;
+
+        struct context {
+            SDL_Window *window;
+            SDL_GLContext gl_ctx;
+            std::unique_ptr<Renderer> renderer;
+            GLuint framebuffer, color_buffer;
+        };
+
+        auto make_image = [](Renderer &rend, std::uint8_t r, std::uint8_t g, std::uint8_t b) {
+            static_assert(sizeof(gpc::gui::rgba32) == 4, "rgba32 must be 4 bytes");
+            std::vector<gpc::gui::rgba32> pixels(size * size);
+            for (auto &pixel : pixels) {
+                const std::uint8_t rgba[4] = { r, g, b, 255 };
+                std::memcpy(&pixel, rgba, 4);
+            }
+            return rend.register_rgba32_image(size, size, &pixels[0]);
+        };
+
+        auto make_current = [](context &ctx) {
+            SDL_GL_MakeCurrent(ctx.window, ctx.gl_ctx);
+            glbinding::Binding::useCurrentContext();
+            glBindFramebuffer(GL_FRAMEBUFFER, ctx.framebuffer);
+            ctx.renderer->enter_context();
+        };
+
+        auto draw_and_read = [](context &ctx, typename Renderer::image_handle image) {
+            std::uint8_t pixel[4];
+            ctx.renderer->clear({ 0, 0, 0, 1 });
+            ctx.renderer->draw_image(0, 0, size, size, image);
+            glFinish();
+            glReadPixels(size / 2, size / 2, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+            return std::vector<int>{ pixel[0], pixel[1], pixel[2] };
+        };
+
+        int failures = 0;
+        auto check = [&](bool ok, const char *what) {
+            cout << (ok ? "  OK      " : "  FAILED  ") << what << "\n";
+            if (!ok) failures++;
+        };
+
+        cout << "Shared contexts:\n";
+
+        context ctx[2];
+        for (auto i = 0; i < 2; i++) {
+            // The second context shares the objects of the first (current) one
+            SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, i > 0 ? 1 : 0);
+            ctx[i].window = SDL_CreateWindow("GPC GUI OpenGL shared context", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
+                size, size, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+            ctx[i].gl_ctx = SDL_GL_CreateContext(ctx[i].window);
+            if (!ctx[i].gl_ctx) throw std::runtime_error(std::string("cannot create GL context: ") + SDL_GetError());
+            glbinding::Binding::initialize();
+
+            // Framebuffers are not shared, and hidden windows may not own their pixels
+            glGenRenderbuffers(1, &ctx[i].color_buffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, ctx[i].color_buffer);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+            glGenFramebuffers(1, &ctx[i].framebuffer);
+            glBindFramebuffer(GL_FRAMEBUFFER, ctx[i].framebuffer);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ctx[i].color_buffer);
+
+            if (i == 0) ctx[i].renderer.reset(new Renderer());
+            else ctx[i].renderer.reset(new Renderer(ctx[0].renderer->resource_context()));
+            ctx[i].renderer->init();
+            ctx[i].renderer->define_viewport(0, 0, size, size);
+        }
+        SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+
+        // Register in the first context, draw in the second
+        make_current(ctx[0]);
+        auto red = make_image(*ctx[0].renderer, 255, 0, 0);
+        glFinish();
+        make_current(ctx[1]);
+        check(draw_and_read(ctx[1], red) == std::vector<int>{ 255, 0, 0 }, "image registered by the other renderer");
+
+        // Replace the image while the second context still has it bound; GL will often hand out
+        // the same texture name again, which the second renderer must not mistake for its binding
+        make_current(ctx[0]);
+        ctx[0].renderer->release_rgba32_image(red);
+        auto green = make_image(*ctx[0].renderer, 0, 255, 0);
+        glFinish();
+        make_current(ctx[1]);
+        check(draw_and_read(ctx[1], green) == std::vector<int>{ 0, 255, 0 }, "image replaced by the other renderer");
+
+        // Accounting covers both renderers
+        auto usage0 = ctx[0].renderer->gpu_memory(), usage1 = ctx[1].renderer->gpu_memory();
+        check(usage0.total == usage1.total && usage0.images == size * size * 4, "shared memory accounting");
+
+        for (auto i = 2; i-- > 0; ) {
+            SDL_GL_MakeCurrent(ctx[i].window, ctx[i].gl_ctx);
+            glbinding::Binding::useCurrentContext();
+            ctx[i].renderer->leave_context();
+            if (i == 0) ctx[i].renderer->release_rgba32_image(green);
+            glDeleteFramebuffers(1, &ctx[i].framebuffer);
+            glDeleteRenderbuffers(1, &ctx[i].color_buffer);
+            ctx[i].renderer.reset();
+            SDL_GL_DeleteContext(ctx[i].gl_ctx);
+            SDL_DestroyWindow(ctx[i].window);
+        }
+
+        return failures;
+    }
+
 } // unnamed ns
 
-int main(int /*argc*/, char * /*argv*/[])
+int main(int argc, char *argv[])
 {
     try {
 
@@ -191,6 +305,13 @@ int main(int /*argc*/, char * /*argv*/[])
         typedef gpc::gui::gl::renderer<true> renderer_t;
         typedef gpc::gui::TestImageGenerator<renderer_t> generator_t;
 
+        // Non-interactive check of resource sharing between renderers (e.g. under Mesa)
+        if (argc > 1 && std::string(argv[1]) == "--shared-contexts") {
+            auto failures = test_shared_contexts<renderer_t>();
+            SDL_Quit();
+            return failures == 0 ? 0 : 1;
+        }
+
         generator_t gen;
 
         // Create a GL renderer
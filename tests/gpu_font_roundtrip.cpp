@@ -0,0 +1,142 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+
+#include <gpc/fonts/rasterized_font.hpp>
+#include <gpc/gui/gl/gpu_font.hpp>
+
+/*  Writes a small rasterized font in GPU-ready format, maps it back and compares; then checks
+    that mapped_gpu_font rejects corrupted copies of the file.
+ */
+
+using namespace gpc::gui::gl;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << __FILE__ << "(" << __LINE__ << "): check failed: " #cond << std::endl; failures++; } } while (0)
+
+static const char *const file_name = "gpu_font_roundtrip.gpufont";
+
+static auto make_font() -> gpc::fonts::rasterized_font
+{
+    gpc::fonts::rasterized_font font;
+
+    font.variants.resize(2);
+    for (auto v = 0U; v < font.variants.size(); v++) {
+        auto &variant = font.variants[v];
+        variant.glyphs.resize(3);
+        for (auto i = 0U; i < variant.glyphs.size(); i++) {
+            auto &glyph = variant.glyphs[i];
+            glyph.cbox.bounds.x_min = 0, glyph.cbox.bounds.x_max = 2 + v;
+            glyph.cbox.bounds.y_min = -1, glyph.cbox.bounds.y_max = 2;
+            glyph.cbox.adv_x = 3 + v;
+            glyph.pixel_base = i * (2 + v) * 3;
+        }
+        variant.pixels.resize(variant.glyphs.size() * (2 + v) * 3);
+        for (auto i = 0U; i < variant.pixels.size(); i++) variant.pixels[i] = static_cast<std::uint8_t>(i * 7 + v);
+    }
+
+    return font;
+}
+
+static auto serialize(const gpc::fonts::rasterized_font &font) -> std::string
+{
+    std::ostringstream os(std::ios::binary);
+    write_gpu_font(os, font);
+    return os.str();
+}
+
+static void save(const std::string &bytes)
+{
+    std::ofstream os(file_name, std::ios::binary);
+    os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+static void check_roundtrip(const gpc::fonts::rasterized_font &font)
+{
+    save(serialize(font));
+    mapped_gpu_font file(file_name);
+
+    const auto &hdr = file.header();
+    CHECK(hdr.version == gpu_font_version);
+    CHECK(hdr.variant_count == font.variants.size());
+    CHECK(hdr.glyph_count == font.variants[0].glyphs.size());
+
+    auto table = make_glyph_table(font);
+    CHECK(std::memcmp(file.glyphs(), table.data(), table.size() * sizeof(gpu_font_glyph)) == 0);
+    CHECK(file.glyphs()[3].adv_x == 4 * 64); // advances are stored in 26.6 fixed point
+
+    for (auto i = 0U; i < hdr.variant_count; i++) {
+        const auto &pixels = font.variants[i].pixels;
+        CHECK(file.variant(i).pixels_size == pixels.size());
+        CHECK(file.variant(i).pixels_offset % 8 == 0);
+        CHECK(std::memcmp(file.variant_pixels(i), pixels.data(), pixels.size()) == 0);
+    }
+
+    for (auto i = 0U; i < hdr.codepoint_count; i++) {
+        CHECK(file.codepoints()[i].glyph == font.find_glyph(file.codepoints()[i].codepoint));
+        if (i > 0) CHECK(file.codepoints()[i - 1].codepoint < file.codepoints()[i].codepoint);
+    }
+}
+
+static void check_rejected(const char *what, const std::string &original, std::function<void(gpu_font_header &, std::string &)> corrupt)
+{
+    auto bytes = original;
+    gpu_font_header hdr;
+    std::memcpy(&hdr, bytes.data(), sizeof(hdr));
+    corrupt(hdr, bytes);
+    std::memcpy(&bytes[0], &hdr, sizeof(hdr));
+    save(bytes);
+
+    try {
+        mapped_gpu_font file(file_name);
+        std::cerr << "corrupt file accepted: " << what << std::endl;
+        failures++;
+    }
+    catch(const std::runtime_error &) {}
+}
+
+int main()
+{
+    auto font = make_font();
+
+    check_roundtrip(font);
+
+    auto bytes = serialize(font);
+
+    auto glyph_at = [](const gpu_font_header &h, std::string &b, size_t index) {
+        return reinterpret_cast<gpu_font_glyph*>(&b[static_cast<size_t>(h.glyphs_offset)]) + index;
+    };
+    auto variant_at = [](const gpu_font_header &h, std::string &b, size_t index) {
+        return reinterpret_cast<gpu_font_variant*>(&b[static_cast<size_t>(h.variants_offset)]) + index;
+    };
+
+    check_rejected("truncated", bytes, [](gpu_font_header &, std::string &b) { b.resize(b.size() / 2); });
+    check_rejected("bad magic", bytes, [](gpu_font_header &h, std::string &) { h.magic[0] = 'X'; });
+    check_rejected("old version", bytes, [](gpu_font_header &h, std::string &) { h.version = 1; });
+    check_rejected("no glyphs", bytes, [](gpu_font_header &h, std::string &) { h.glyph_count = 0; });
+    check_rejected("fallback glyph", bytes, [](gpu_font_header &h, std::string &) { h.fallback_glyph = static_cast<std::int32_t>(h.glyph_count); });
+    check_rejected("empty pixels", bytes, [&](gpu_font_header &h, std::string &b) { variant_at(h, b, 1)->pixels_size = 0; });
+    check_rejected("glyph pixels", bytes, [&](gpu_font_header &h, std::string &b) { glyph_at(h, b, 2)->pixel_base += 1; });
+    check_rejected("glyph size", bytes, [&](gpu_font_header &h, std::string &b) { glyph_at(h, b, 5)->y_max += 1; });
+    gpu_font_header hdr;
+    std::memcpy(&hdr, bytes.data(), sizeof(hdr));
+    if (hdr.codepoint_count > 0) {
+        check_rejected("codepoint glyph", bytes, [](gpu_font_header &h, std::string &b) {
+            reinterpret_cast<gpu_font_codepoint*>(&b[static_cast<size_t>(h.codepoints_offset)])->glyph = static_cast<std::int32_t>(h.glyph_count);
+        });
+    }
+
+    std::remove(file_name);
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "gpu_font round trip OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+#include <gpc/gui/gl/renderer.hpp>
+
+#include "null_gl_calls.hpp"
+
+/*  Checks the memory ledger, then the order in which the renderer evicts images to stay within
+    its memory budget (using a GL call policy that needs no OpenGL context).
+ */
+
+using namespace gpc::gui::gl;
+
+using renderer_t = renderer<true, null_config>;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << __FILE__ << "(" << __LINE__ << "): check failed: " #cond << std::endl; failures++; } } while (0)
+
+static void test_memory_ledger()
+{
+    memory_ledger ledger;
+
+    ledger.allocate(1, memory_category::images, 1000, "a");
+    ledger.allocate(2, memory_category::fonts, 300, "b");
+    ledger.allocate(3, memory_category::images, 500, "c");
+    CHECK(ledger.total() == 1800);
+    CHECK(ledger.total(memory_category::images) == 1500);
+    CHECK(ledger.total(memory_category::fonts) == 300);
+    CHECK(ledger.count() == 3);
+
+    // Allocating under an existing key replaces the allocation
+    ledger.allocate(1, memory_category::layers, 200, "a'");
+    CHECK(ledger.total() == 1000);
+    CHECK(ledger.total(memory_category::images) == 500);
+    CHECK(ledger.total(memory_category::layers) == 200);
+    CHECK(ledger.count() == 3);
+    CHECK(ledger.peak() == 1800);
+
+    auto largest = ledger.largest(2);
+    CHECK(largest.size() == 2);
+    CHECK(largest.size() == 2 && largest[0].label == "c" && largest[1].label == "b");
+    CHECK(ledger.largest(10).size() == 3);
+
+    // Releasing an unknown key does nothing
+    ledger.release(42);
+    ledger.release(3);
+    ledger.release(3);
+    CHECK(ledger.total() == 500);
+    CHECK(ledger.total(memory_category::images) == 0);
+    CHECK(ledger.count() == 2);
+    CHECK(ledger.peak() == 1800);
+
+    std::ostringstream os;
+    ledger.dump(os);
+    CHECK(os.str().find("500 bytes in 2 allocations") != std::string::npos);
+}
+
+static void test_eviction_order()
+{
+    renderer_t rend;
+    std::vector<gpc::gui::rgba32> pixels(16 * 16);
+
+    // Four 1 KB images, made evictable (which counts as a use) in the order 2, 0, 3, 1
+    std::vector<renderer_t::image_handle> images;
+    for (auto i = 0; i < 4; i++) images.push_back(rend.register_rgba32_image(16, 16, &pixels[0]));
+    CHECK(rend.gpu_memory().images == 4 * 1024);
+
+    std::vector<renderer_t::image_handle> evicted;
+    for (auto i : { 2, 0, 3, 1 }) rend.make_image_evictable(images[i], [&](renderer_t::image_handle h) { evicted.push_back(h); });
+
+    size_t excess = 0;
+    rend.set_memory_budget(2 * 1024 + 512, [&](size_t e) { excess = e; });
+    rend.enforce_memory_budget();
+    CHECK((evicted == std::vector<renderer_t::image_handle>{ images[2], images[0] }));
+    CHECK(rend.gpu_memory().images == 2 * 1024);
+    CHECK(excess == 0);
+
+    // Nothing left to evict: the callback reports the excess
+    rend.set_memory_budget(512, [&](size_t e) { excess = e; });
+    rend.enforce_memory_budget();
+    CHECK(evicted.size() == 4);
+    CHECK(excess == 0);
+    auto extra = rend.register_rgba32_image(16, 16, &pixels[0]); // not evictable
+    CHECK(excess == 512);
+    CHECK(rend.gpu_memory().images == 1024);
+    rend.release_rgba32_image(extra);
+}
+
+static void test_eviction_pins()
+{
+    auto resources = std::make_shared<renderer_t::shared_resources>();
+    renderer_t rend1(resources), rend2(resources);
+    std::vector<gpc::gui::rgba32> pixels(16 * 16);
+
+    auto used = rend1.register_rgba32_image(16, 16, &pixels[0]);
+    auto unused = rend1.register_rgba32_image(16, 16, &pixels[0]);
+    std::vector<renderer_t::image_handle> evicted;
+    for (auto image : { used, unused }) rend1.make_image_evictable(image, [&](renderer_t::image_handle h) { evicted.push_back(h); });
+
+    renderer_t::retained_scene scene(rend2);
+    auto node = scene.add_image(0, 0, 16, 16, used);
+
+    // No eviction while another renderer sharing the resources is recording
+    rend1.set_memory_budget(1);
+    rend2.begin_sorted();
+    rend1.enforce_memory_budget();
+    CHECK(evicted.empty());
+    rend2.end_sorted();
+
+    // Images used by a retained scene stay, even if least recently used
+    rend1.enforce_memory_budget();
+    CHECK((evicted == std::vector<renderer_t::image_handle>{ unused }));
+
+    // ... until the scene stops using them
+    scene.remove(node);
+    rend1.enforce_memory_budget();
+    CHECK((evicted == std::vector<renderer_t::image_handle>{ unused, used }));
+}
+
+int main()
+{
+    test_memory_ledger();
+    test_eviction_order();
+    test_eviction_pins();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
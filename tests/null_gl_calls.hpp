@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstring>
+#include <utility>
+
+#include <gpc/gui/gl/policies.hpp>
+
+namespace gpc {
+
+    namespace gui {
+
+        namespace gl {
+
+            /** GL call policy for tests of the renderer's CPU-side logic: no OpenGL function is
+                ever called (no context is needed), every call returns a value-initialized result,
+                and the glGen*() functions hand out fresh object names.
+             */
+            struct null_gl_calls {
+
+                template <typename F, typename... Args>
+                static auto call(const char * /*name*/, F fn, Args&&... args) -> decltype(fn(std::forward<Args>(args)...))
+                {
+                    return decltype(fn(std::forward<Args>(args)...))();
+                }
+
+                template <typename F>
+                static void call(const char *name, F /*fn*/, GLsizei count, GLuint *names)
+                {
+                    if (std::strncmp(name, "Gen", 3) != 0) return;
+                    for (auto i = 0; i < count; i++) names[i] = ++last_name();
+                }
+
+            private:
+
+                static auto last_name() -> GLuint & { static GLuint name = 0; return name; }
+            };
+
+            using null_config = renderer_config<null_gl_calls, no_instrumentation>;
+
+        } // ns gl
+    } // ns gui
+} // ns gpc
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <gpc/gui/gl/renderer.hpp>
+
+#include "null_gl_calls.hpp"
+
+/*  Checks how a retained scene places its nodes into batches, re-uses freed instance records and
+    updates only what changed (using a GL call policy that needs no OpenGL context).
+ */
+
+using namespace gpc::gui::gl;
+
+using renderer_t = renderer<true, null_config>;
+using scene_t = renderer_t::retained_scene;
+
+static int failures = 0;
+
+#define CHECK(cond) do { if (!(cond)) { std::cerr << __FILE__ << "(" << __LINE__ << "): check failed: " #cond << std::endl; failures++; } } while (0)
+
+static const gpc::gui::rgba_norm red = {{ 1, 0, 0, 1 }};
+
+// Size of the scene's instance buffer, as listed by the memory dump
+static auto instance_buffer_size(const renderer_t &rend) -> size_t
+{
+    std::ostringstream os;
+    rend.dump_gpu_memory(os);
+
+    std::istringstream is(os.str());
+    for (std::string line; std::getline(is, line); ) {
+        if (line.find("scene instances") != std::string::npos) return std::stoul(line);
+    }
+    return 0;
+}
+
+static void test_placement()
+{
+    renderer_t rend;
+    scene_t scene(rend);
+
+    // Two rectangles around an image they do not overlap: the rectangles share a batch
+    scene.add_rect(0, 0, 10, 10, red);
+    scene.add_image(100, 0, 10, 10, 1);
+    auto rect = scene.add_rect(200, 0, 10, 10, red);
+    scene.update();
+    CHECK(scene.statistics().nodes == 3);
+    CHECK(scene.statistics().instances == 3);
+    CHECK(scene.statistics().batches == 2);
+    CHECK(scene.statistics().draw_commands == 3); // the rectangles' records are not contiguous
+
+    // Moved onto the image, the second rectangle must be drawn after it
+    scene.set_position(rect, 105, 5);
+    scene.update();
+    CHECK(scene.statistics().batches == 3);
+
+    // Moved elsewhere, it keeps its batch as long as that respects its overlaps
+    scene.set_position(rect, 300, 0);
+    scene.update();
+    CHECK(scene.statistics().batches == 3);
+
+    // A different image needs a batch of its own
+    scene.add_image(400, 0, 10, 10, 2);
+    scene.update();
+    CHECK(scene.statistics().batches == 4);
+
+    // Removing nodes leaves their batches empty
+    scene.remove(rect);
+    scene.update();
+    CHECK(scene.statistics().nodes == 3);
+    CHECK(scene.statistics().batches == 3);
+    CHECK(scene.statistics().draw_commands == 3);
+}
+
+static void test_incremental_updates()
+{
+    renderer_t rend;
+    scene_t scene(rend);
+
+    std::vector<scene_t::node_id> rects;
+    for (auto i = 0; i < 200; i++) rects.push_back(scene.add_rect(i * 20, 0, 10, 10, red));
+    scene.update();
+    auto full_upload = scene.statistics().bytes_uploaded;
+    auto buffer_size = instance_buffer_size(rend);
+    CHECK(buffer_size > 0);
+    CHECK(full_upload > 0);
+    CHECK(scene.statistics().batches == 1);
+    CHECK(scene.statistics().draw_commands == 1);
+
+    // Nothing changed, nothing uploaded
+    scene.update();
+    CHECK(scene.statistics().bytes_uploaded == 0);
+
+    // Moving one node uploads its record and its batch's draw commands only
+    scene.set_position(rects[50], 10000, 0);
+    scene.update();
+    CHECK(scene.statistics().bytes_uploaded > 0);
+    CHECK(scene.statistics().bytes_uploaded * 20 < full_upload);
+
+    // Removed nodes leave gaps in the records, which split the draw commands...
+    for (auto i = 0; i < 200; i += 2) scene.remove(rects[i]);
+    scene.update();
+    CHECK(scene.statistics().nodes == 100);
+    CHECK(scene.statistics().instances == 100);
+    CHECK(scene.statistics().draw_commands == 100);
+
+    // ... which new nodes re-use: the instance buffer (256 records at first) does not grow
+    for (auto i = 0; i < 100; i++) scene.add_rect(i * 20, 100, 10, 10, red);
+    scene.update();
+    CHECK(scene.statistics().instances == 200);
+    CHECK(scene.statistics().batches == 1);
+    CHECK(instance_buffer_size(rend) == buffer_size);
+}
+
+int main()
+{
+    test_placement();
+    test_incremental_updates();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
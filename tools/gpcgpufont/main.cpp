@@ -0,0 +1,45 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/vector.hpp>
+
+#include <gpc/fonts/rasterized_font.hpp>
+#include <gpc/gui/gl/gpu_font.hpp>
+
+/*  Usage: gpcgpufont <input> <output>
+
+    <input> is a rasterized font serialized with Cereal's binary archive (as produced by
+    the libGPCFonts tools), <output> receives the font in GPU-ready format, to be loaded 
+    via gpc::gui::gl::mapped_gpu_font.
+ */
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <rasterized font file> <GPU-ready font file>" << std::endl;
+        return 2;
+    }
+
+    try {
+
+        gpc::fonts::rasterized_font font;
+        {
+            std::ifstream is(argv[1], std::ios::binary);
+            if (!is) throw std::runtime_error(std::string("cannot open \"") + argv[1] + "\"");
+            cereal::BinaryInputArchive archive(is);
+            archive(font);
+        }
+
+        std::ofstream os(argv[2], std::ios::binary);
+        if (!os) throw std::runtime_error(std::string("cannot create \"") + argv[2] + "\"");
+        gpc::gui::gl::write_gpu_font(os, font);
+
+        return 0;
+    }
+    catch(const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+
+    return 1;
+}